@@ -0,0 +1,409 @@
+
+#pragma once
+
+#include "Utility/FlatBuilder.h"
+#include "Utility/StringView.h"
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace Utility
+{
+    /**
+     * ArrowOutput.  Table rows as an Arrow IPC stream: a schema message,
+     * then record batches of up to 'batch' rows, then the end-of-stream
+     * marker.  Every column (the source label first) is a nullable utf8
+     * column; a missing value is null.  Columns whose values repeat
+     * enough in the first batch are dictionary encoded, with each batch
+     * preceded by (replacement) dictionaries for those columns.
+     * Column names come from the header titles (see AgentSet::headers),
+     * which take the place of a header row.
+     * Copies made for other streams (--jobs workers) share the schema and
+     * write their batches there; the schema goes out on the original
+     * stream, ahead of any batch, and the original writes the end marker.
+     */
+    class ArrowOutput
+    {
+    public:
+        explicit
+        ArrowOutput(std::ostream& os = std::cout, size_t batch = 1 << 16)
+        : os_(os)
+        , schema_(std::make_shared<Schema>(os))
+        , batch_(batch)
+        , columns_()
+        , rows_(0)
+        , bytes_(0)
+        , column_(0)
+        , primary_(true)
+        {}
+
+        // same configuration, different stream
+        ArrowOutput(ArrowOutput const& other, std::ostream& os)
+        : os_(os)
+        , schema_(other.schema_)
+        , batch_(other.batch_)
+        , columns_(schema_->names_.size())
+        , rows_(0)
+        , bytes_(0)
+        , column_(0)
+        , primary_(false)
+        {
+            prepare(); // no sample here: the batches written so far are on other streams
+        }
+
+        ~ArrowOutput()
+        {
+            flush();
+            if ( primary_ )
+            {
+                prepare();
+                os_.write( "\xFF\xFF\xFF\xFF\0\0\0\0", 8 );
+                os_.flush();
+            }
+        }
+
+        ArrowOutput& batch( size_t rows )
+        {
+            batch_ = rows > 0 ? rows : 1;
+            return *this;
+        }
+
+        // column names
+        template<typename Iterator>
+        void operator() ( Iterator begin, Iterator const end )
+        {
+            schema_->names_.assign( begin, end );
+            columns_.assign( schema_->names_.size(), Column() );
+        }
+
+        void label( std::string const& label )
+        {
+            column_ = 0;
+            item( label );
+        }
+
+        void item( StringView const& item )
+        {
+            if ( column_ < columns_.size() )
+            {
+                columns_[column_++].add( item );
+                bytes_ += item.size();
+            }
+        }
+
+        void no_data()
+        {
+            if ( column_ < columns_.size() )
+            {
+                columns_[column_++].add_null();
+            }
+        }
+
+        void end()
+        {
+            while ( column_ < columns_.size() )
+            {
+                columns_[column_++].add_null();
+            }
+            // offsets are 32-bit
+            if ( ++rows_ >= batch_ or bytes_ >= (1u << 30) )
+            {
+                flush();
+            }
+        }
+
+    private:
+        ArrowOutput(ArrowOutput const&) = delete;
+        ArrowOutput& operator= ( ArrowOutput const& ) = delete;
+
+        struct Schema
+        {
+            explicit
+            Schema(std::ostream& os)
+            : os_(os)
+            , names_()
+            , dictionary_()
+            , written_(false)
+            , mutex_()
+            {}
+
+            std::ostream&               os_;        // of the original
+            std::vector<std::string>    names_;
+            std::vector<bool>           dictionary_;
+            bool                        written_;
+            std::mutex                  mutex_;
+        };
+
+        // a batch's worth of one utf8 column
+        struct Column
+        {
+            Column()
+            : offsets_(1, 0)
+            , data_()
+            , valid_()
+            , nulls_(0)
+            {}
+
+            size_t size() const { return offsets_.size() - 1; }
+
+            void add( StringView const& value )
+            {
+                mark( true );
+                data_.append( value.data(), value.size() );
+                offsets_.push_back( static_cast<int32_t>(data_.size()) );
+            }
+
+            void add_null()
+            {
+                mark( false );
+                ++nulls_;
+                offsets_.push_back( static_cast<int32_t>(data_.size()) );
+            }
+
+            StringView value( size_t row ) const
+            {
+                return StringView(data_.data() + offsets_[row], offsets_[row + 1] - offsets_[row]);
+            }
+
+            bool valid( size_t row ) const
+            {
+                return valid_[row / 8] & (1 << (row % 8));
+            }
+
+            void clear()
+            {
+                offsets_.resize( 1 );
+                data_.clear();
+                valid_.clear();
+                nulls_ = 0;
+            }
+
+            void mark( bool valid )
+            {
+                size_t const    _row(size());
+                if ( _row % 8 == 0 )
+                {
+                    valid_.push_back( 0 );
+                }
+                if ( valid )
+                {
+                    valid_.back() |= 1 << (_row % 8);
+                }
+            }
+
+            std::vector<int32_t>    offsets_;
+            std::string             data_;
+            std::vector<uint8_t>    valid_;
+            size_t                  nulls_;
+        };
+
+        typedef std::vector<std::pair<int64_t, int64_t> >   Pairs;
+
+        // the body of a message: buffers, each padded to 8 bytes
+        struct Body
+        {
+            void add( void const* data, size_t size )
+            {
+                buffers_.push_back( { static_cast<int64_t>(length_), static_cast<int64_t>(size) } );
+                parts_.push_back( { static_cast<char const*>(data), size } );
+                length_ += (size + 7) / 8 * 8;
+            }
+
+            void column( Column const& column )
+            {
+                nodes_.push_back( { static_cast<int64_t>(column.size()), static_cast<int64_t>(column.nulls_) } );
+                add( column.valid_.data(), column.nulls_ > 0 ? column.valid_.size() : 0 );
+                add( column.offsets_.data(), column.offsets_.size() * sizeof(int32_t) );
+                add( column.data_.data(), column.data_.size() );
+            }
+
+            void indices( Column const& column, std::vector<int32_t> const& indices )
+            {
+                nodes_.push_back( { static_cast<int64_t>(column.size()), static_cast<int64_t>(column.nulls_) } );
+                add( column.valid_.data(), column.nulls_ > 0 ? column.valid_.size() : 0 );
+                add( indices.data(), indices.size() * sizeof(int32_t) );
+            }
+
+            Pairs                                           nodes_;
+            Pairs                                           buffers_;
+            std::vector<std::pair<char const*, size_t> >    parts_;
+            size_t                                          length_ = 0;
+        };
+
+        enum Header { SchemaMessage = 1, DictionaryBatch = 2, RecordBatch = 3 };
+
+        static bool little_endian()
+        {
+            uint16_t const  _probe(1);
+            return *reinterpret_cast<uint8_t const*>(&_probe) == 1;
+        }
+
+        // writes the schema message once; dictionary columns are those whose
+        // distinct values average 4 or more uses each in the rows held now
+        // (with none, just the source label)
+        void prepare()
+        {
+            std::lock_guard<std::mutex>     _lock(schema_->mutex_);
+            if ( schema_->written_ )
+            {
+                return;
+            }
+            schema_->dictionary_.assign( columns_.size(), false );
+            for ( size_t _c(0); _c < columns_.size(); ++_c )
+            {
+                schema_->dictionary_[_c] = rows_ == 0 ? _c == 0 : repetitive( columns_[_c] );
+            }
+
+            FlatBuilder             _meta;
+            auto                    _message(message( _meta, SchemaMessage, 0 ));
+            auto                    _schema(_meta.table( _message, { { 0, 2, little_endian() ? 0u : 1u }, { 1, 0, 0 } } ));
+            auto                    _fields(_meta.tables( _schema[0], schema_->names_.size() ));
+            for ( size_t _c(0); _c < _fields.size(); ++_c )
+            {
+                bool const  _dictionary(schema_->dictionary_[_c]);
+                auto        _field(_meta.table( _fields[_c], _dictionary
+                    ? std::vector<FlatBuilder::Slot>{ { 0, 0, 0 }, { 1, 1, 1 }, { 2, 1, 5 }, { 3, 0, 0 }, { 4, 0, 0 }, { 5, 0, 0 } }
+                    : std::vector<FlatBuilder::Slot>{ { 0, 0, 0 }, { 1, 1, 1 }, { 2, 1, 5 }, { 3, 0, 0 }, { 5, 0, 0 } }
+                    ));
+                _meta.string( _field[0], schema_->names_[_c] );
+                _meta.table( _field[1], {} ); // Utf8
+                if ( _dictionary )
+                {
+                    auto    _encoding(_meta.table( _field[2], { { 0, 8, _c }, { 1, 0, 0 } } ));
+                    _meta.table( _encoding[0], { { 0, 4, 32 }, { 1, 1, 1 } } ); // int32 indices
+                }
+                _meta.tables( _field.back(), 0 ); // no children
+            }
+            Body                    _none;
+            write( schema_->os_, _meta, _none );
+            schema_->os_.flush();
+            schema_->written_ = true;
+        }
+
+        static bool repetitive( Column const& column )
+        {
+            size_t const                    _values(column.size() - column.nulls_);
+            std::unordered_set<std::string> _distinct;
+            for ( size_t _r(0); _r < column.size(); ++_r )
+            {
+                if ( column.valid( _r ) )
+                {
+                    _distinct.insert( column.value( _r ) );
+                    if ( _distinct.size() * 4 > _values )
+                    {
+                        return false;
+                    }
+                }
+            }
+            return _values > 0;
+        }
+
+        void flush()
+        {
+            if ( rows_ == 0 )
+            {
+                return;
+            }
+            prepare();
+            Body                            _batch;
+            std::vector<Column>             _dictionaries(columns_.size());
+            std::vector<std::vector<int32_t> >  _indices(columns_.size());
+            for ( size_t _c(0); _c < columns_.size(); ++_c )
+            {
+                if ( !schema_->dictionary_[_c] )
+                {
+                    _batch.column( columns_[_c] );
+                    continue;
+                }
+                encode( columns_[_c], _dictionaries[_c], _indices[_c] );
+                Body        _values;
+                _values.column( _dictionaries[_c] );
+                FlatBuilder _meta;
+                auto        _dictionary(_meta.table( message( _meta, DictionaryBatch, _values.length_ ), { { 0, 8, _c }, { 1, 0, 0 } } ));
+                batch( _meta, _dictionary[0], _dictionaries[_c].size(), _values );
+                write( os_, _meta, _values );
+                _batch.indices( columns_[_c], _indices[_c] );
+            }
+            FlatBuilder                     _meta;
+            batch( _meta, message( _meta, RecordBatch, _batch.length_ ), rows_, _batch );
+            write( os_, _meta, _batch );
+            os_.flush();
+
+            for ( auto& column : columns_ )
+            {
+                column.clear();
+            }
+            rows_ = bytes_ = 0;
+        }
+
+        // distinct values in order of first use, and an index per row
+        static void encode( Column const& column, Column& dictionary, std::vector<int32_t>& indices )
+        {
+            std::unordered_map<std::string, int32_t>    _index;
+            indices.assign( column.size(), 0 );
+            for ( size_t _r(0); _r < column.size(); ++_r )
+            {
+                if ( column.valid( _r ) )
+                {
+                    auto    _entry(_index.emplace( column.value( _r ), static_cast<int32_t>(_index.size()) ));
+                    if ( _entry.second )
+                    {
+                        dictionary.add( column.value( _r ) );
+                    }
+                    indices[_r] = _entry.first->second;
+                }
+            }
+        }
+
+        // Message table; returns the Ref of its header
+        static FlatBuilder::Ref message( FlatBuilder& meta, Header header, size_t length )
+        {
+            return meta.table( meta.root(), { { 0, 2, 4 }, { 1, 1, static_cast<uint64_t>(header) }, { 2, 0, 0 }, { 3, 8, length } } )[0]; // V5
+        }
+
+        static void batch( FlatBuilder& meta, FlatBuilder::Ref at, size_t rows, Body const& body )
+        {
+            auto    _batch(meta.table( at, { { 0, 8, rows }, { 1, 0, 0 }, { 2, 0, 0 } } ));
+            meta.pairs( _batch[0], body.nodes_ );
+            meta.pairs( _batch[1], body.buffers_ );
+        }
+
+        // encapsulated message: continuation, metadata length, metadata
+        // (padded to 8 bytes), body
+        static void write( std::ostream& os, FlatBuilder const& meta, Body const& body )
+        {
+            static char const   _zeros[8] = {};
+            auto const&         _data(meta.data());
+            size_t const        _padded((_data.size() + 7) / 8 * 8);
+            char const          _prefix[8] =
+            {
+                '\xFF', '\xFF', '\xFF', '\xFF',
+                char(_padded), char(_padded >> 8), char(_padded >> 16), char(_padded >> 24)
+            };
+            os.write( _prefix, sizeof _prefix );
+            os.write( reinterpret_cast<char const*>(_data.data()), _data.size() );
+            os.write( _zeros, _padded - _data.size() );
+            for ( auto const& part : body.parts_ )
+            {
+                os.write( part.first, part.second );
+                os.write( _zeros, (part.second + 7) / 8 * 8 - part.second );
+            }
+        }
+
+        std::ostream&               os_;
+        std::shared_ptr<Schema>     schema_;
+        size_t                      batch_;
+        std::vector<Column>         columns_;
+        size_t                      rows_;
+        size_t                      bytes_;
+        size_t                      column_;
+        bool                        primary_;
+    };
+
+} // namespace Utility
@@ -0,0 +1,116 @@
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace Utility
+{
+    /**
+     * BoundedQueue.  Blocking multi-producer, multi-consumer queue with
+     * a fixed capacity.  After close(), push() fails and pop() drains
+     * whatever is left, then fails.
+     * Counters show which side of a queue between two stages keeps the
+     * other waiting: pushes that found it full (the consumer is slower),
+     * pops that found it empty (the producer is slower), and its depth.
+     */
+    template<typename T>
+    class BoundedQueue
+    {
+    public:
+        explicit
+        BoundedQueue(size_t capacity)
+        : capacity_(capacity > 0 ? capacity : 1)
+        , closed_(false)
+        , items_()
+        , mutex_()
+        , notEmpty_()
+        , notFull_()
+        , stats_()
+        {}
+
+        struct Stats
+        {
+            size_t      items_;     // pushed
+            size_t      depths_;    // sum of the depths after each push
+            size_t      peak_;
+            size_t      full_;      // pushes that had to wait
+            size_t      empty_;     // pops that had to wait
+
+            double mean() const { return items_ > 0 ? double(depths_) / items_ : 0; }
+        };
+
+        bool push( T&& item )
+        {
+            std::unique_lock<std::mutex>    _lock(mutex_);
+            if ( !closed_ and items_.size() >= capacity_ )
+            {
+                ++stats_.full_;
+            }
+            notFull_.wait( _lock, [&]() -> bool { return closed_ or items_.size() < capacity_; } );
+            if ( closed_ )
+            {
+                return false;
+            }
+            items_.push_back( std::move( item ) );
+            ++stats_.items_;
+            stats_.depths_ += items_.size();
+            stats_.peak_ = std::max( stats_.peak_, items_.size() );
+            notEmpty_.notify_one();
+            return true;
+        }
+
+        bool pop( T& item )
+        {
+            std::unique_lock<std::mutex>    _lock(mutex_);
+            if ( !closed_ and items_.empty() )
+            {
+                ++stats_.empty_;
+            }
+            notEmpty_.wait( _lock, [&]() -> bool { return closed_ or !items_.empty(); } );
+            if ( items_.empty() )
+            {
+                return false;
+            }
+            item = std::move( items_.front() );
+            items_.pop_front();
+            notFull_.notify_one();
+            return true;
+        }
+
+        void close()
+        {
+            std::lock_guard<std::mutex>     _lock(mutex_);
+            closed_ = true;
+            notEmpty_.notify_all();
+            notFull_.notify_all();
+        }
+
+        size_t depth() const
+        {
+            std::lock_guard<std::mutex>     _lock(mutex_);
+            return items_.size();
+        }
+
+        Stats stats() const
+        {
+            std::lock_guard<std::mutex>     _lock(mutex_);
+            return stats_;
+        }
+
+    private:
+        BoundedQueue(BoundedQueue const&) = delete;
+        BoundedQueue& operator= ( BoundedQueue const& ) = delete;
+
+        size_t const                capacity_;
+        bool                        closed_;
+        std::deque<T>               items_;
+        mutable std::mutex          mutex_;
+        std::condition_variable     notEmpty_;
+        std::condition_variable     notFull_;
+        Stats                       stats_;
+    };
+
+} // namespace Utility
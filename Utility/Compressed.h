@@ -0,0 +1,225 @@
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <dlfcn.h>
+#include <zlib.h>
+
+namespace Utility
+{
+    /**
+     * Compressed.  Recognizes gzip and zstd content by its magic bytes, and
+     * expands it in memory into a buffer sized up front from what the
+     * format records of the content size (the gzip trailer; the zstd frame
+     * header), so that compressed inputs are parsed without temp files or
+     * an intermediate stream.  Concatenated members/frames are expanded
+     * one after another.  gzip goes through zlib; zstd through libzstd,
+     * found at run time (there is no build dependency on it), and content
+     * in zstd format fails to expand, with a warning, where it is absent.
+     */
+    class Compressed
+    {
+    public:
+        enum Format { None, Gzip, Zstd };
+
+        static Format format( char const* data, size_t size )
+        {
+            unsigned char const*    _at(reinterpret_cast<unsigned char const*>(data));
+            return size >= 18 and _at[0] == 0x1f and _at[1] == 0x8b ? Gzip
+                 : size >= 9 and _at[0] == 0x28 and _at[1] == 0xb5 and _at[2] == 0x2f and _at[3] == 0xfd ? Zstd
+                 : None
+                 ;
+        }
+
+        // whether content beginning with this byte may be compressed:
+        // XML begins with neither
+        static bool maybe( int first ) { return first == 0x1f or first == 0x28; }
+
+        // the content expanded into out[0, size), with room for a
+        // terminating byte: false on corrupt or truncated content
+        static bool expand( Format format, char const* data, size_t size, std::vector<char>& out, size_t& expanded )
+        {
+            expanded = 0;
+            return format == Gzip ? gunzip( data, size, out, expanded )
+                 : format == Zstd ? unzstd( data, size, out, expanded )
+                 : false
+                 ;
+        }
+
+    private:
+        // makes room for at least one byte more than 'used'
+        static void reserve( std::vector<char>& out, size_t used, size_t hint )
+        {
+            if ( out.size() < used + 2 )
+            {
+                out.resize( std::max( used + 2, std::max( hint + 1, out.size() * 2 ) ) );
+            }
+        }
+
+        static bool gunzip( char const* data, size_t size, std::vector<char>& out, size_t& expanded )
+        {
+            // ISIZE: the size of the (last) member, modulo 2^32
+            unsigned char const*    _trailer(reinterpret_cast<unsigned char const*>(data + size - 4));
+            size_t const            _hint(_trailer[0] | _trailer[1] << 8 | _trailer[2] << 16 | uint32_t(_trailer[3]) << 24);
+            z_stream                _z;
+            std::memset( &_z, 0, sizeof _z );
+            if ( ::inflateInit2( &_z, 15 + 16 ) != Z_OK )
+            {
+                return false;
+            }
+            reserve( out, 0, _hint < size * 1032 ? _hint : size * 4 );
+            _z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+            int                     _rc(Z_OK);
+            for ( size_t _left(size); ; )
+            {
+                reserve( out, expanded, 0 );
+                size_t const    _in(std::min<size_t>( _left, 1u << 30 ));
+                size_t const    _room(std::min<size_t>( out.size() - expanded - 1, 1u << 30 ));
+                _z.avail_in  = _in;
+                _z.next_out  = reinterpret_cast<Bytef*>(out.data() + expanded);
+                _z.avail_out = _room;
+                _rc = ::inflate( &_z, Z_NO_FLUSH );
+                _left    -= _in - _z.avail_in;
+                expanded += _room - _z.avail_out;
+                if ( _rc == Z_STREAM_END )
+                {
+                    // another member, or trailing zeros (as from tar)
+                    if ( _left == 0 or *_z.next_in == 0 or ::inflateReset( &_z ) != Z_OK )
+                    {
+                        break;
+                    }
+                }
+                else
+                if ( _rc != Z_OK and !(_rc == Z_BUF_ERROR and _z.avail_out == 0) )
+                {
+                    break;
+                }
+                else
+                if ( _left == 0 and _z.avail_out > 0 )
+                {
+                    _rc = Z_DATA_ERROR; // truncated
+                    break;
+                }
+            }
+            ::inflateEnd( &_z );
+            return _rc == Z_STREAM_END;
+        }
+
+        /**
+         * ZstdLib.  The few libzstd entry points used, as declared by zstd.h
+         * (stable API since 1.4.0), bound on first use.
+         */
+        struct ZstdLib
+        {
+            struct InBuffer { void const* src_; size_t size_; size_t pos_; };
+            struct OutBuffer { void* dst_; size_t size_; size_t pos_; };
+
+            enum { ResetSession = 1 };  // ZSTD_reset_session_only
+
+            typedef unsigned long long (*ContentSize)( void const*, size_t );
+            typedef void* (*Create)();
+            typedef size_t (*Free)( void* );
+            typedef size_t (*Reset)( void*, int );
+            typedef size_t (*Decompress)( void*, OutBuffer*, InBuffer* );
+            typedef unsigned (*IsError)( size_t );
+
+            ZstdLib()
+            : lib_(::dlopen( "libzstd.so.1", RTLD_NOW | RTLD_LOCAL ))
+            , contentSize_(bind<ContentSize>( "ZSTD_getFrameContentSize" ))
+            , create_(bind<Create>( "ZSTD_createDCtx" ))
+            , free_(bind<Free>( "ZSTD_freeDCtx" ))
+            , reset_(bind<Reset>( "ZSTD_DCtx_reset" ))
+            , decompress_(bind<Decompress>( "ZSTD_decompressStream" ))
+            , isError_(bind<IsError>( "ZSTD_isError" ))
+            {
+                if ( !*this )
+                {
+                    std::cerr << "libzstd.so.1 not found: zstd input cannot be read" << std::endl;
+                }
+            }
+
+            explicit operator bool() const
+            {
+                return contentSize_ and create_ and free_ and reset_ and decompress_ and isError_;
+            }
+
+            template<typename Function>
+            Function bind( char const* name ) const
+            {
+                return lib_ ? reinterpret_cast<Function>(::dlsym( lib_, name )) : nullptr;
+            }
+
+            void*           lib_;
+            ContentSize     contentSize_;
+            Create          create_;
+            Free            free_;
+            Reset           reset_;
+            Decompress      decompress_;
+            IsError         isError_;
+        };
+
+        // a decompression context, freed with its thread
+        struct Context
+        {
+            explicit
+            Context(ZstdLib const& lib)
+            : lib_(lib)
+            , ctx_(lib.create_())
+            {}
+
+            ~Context()
+            {
+                if ( ctx_ )
+                {
+                    lib_.free_( ctx_ );
+                }
+            }
+
+            ZstdLib const&  lib_;
+            void*           ctx_;
+        };
+
+        static bool unzstd( char const* data, size_t size, std::vector<char>& out, size_t& expanded )
+        {
+            static ZstdLib const    _zstd;
+            if ( !_zstd )
+            {
+                return false;
+            }
+            // one context per thread, reused from file to file
+            static thread_local Context _context(_zstd);
+            void* const                 _ctx(_context.ctx_);
+            if ( !_ctx or _zstd.isError_( _zstd.reset_( _ctx, ZstdLib::ResetSession ) ) )
+            {
+                return false;
+            }
+            // the first frame's size, if its header records it
+            unsigned long long const    _hint(_zstd.contentSize_( data, size ));
+            reserve( out, 0, _hint < size * 32768ULL ? _hint : size * 4 );
+            ZstdLib::InBuffer           _in{ data, size, 0 };
+            size_t                      _rc(0);
+            for ( ;; )
+            {
+                reserve( out, expanded, 0 );
+                ZstdLib::OutBuffer      _out{ out.data(), out.size() - 1, expanded };
+                _rc = _zstd.decompress_( _ctx, &_out, &_in );
+                expanded = _out.pos_;
+                if ( _zstd.isError_( _rc ) )
+                {
+                    break;
+                }
+                if ( _in.pos_ == _in.size_ and (_rc == 0 or _out.pos_ < _out.size_) )
+                {
+                    break;  // all input consumed: at the end of a frame, or short
+                }
+            }
+            return !_zstd.isError_( _rc ) and _rc == 0;
+        }
+    };
+
+} // namespace Utility
@@ -1,6 +1,10 @@
 
 #pragma once
 
+#include "Utility/MappedFile.h"
+#include "Utility/Stats.h"
+#include "Utility/UringLoader.h"
+
 #include <fstream>
 #include <iostream>
 #include <algorithm>
@@ -14,6 +18,7 @@ namespace Utility
         {
             void on_warning( std::string const& msg )
             {
+                Stats::count( Stats::Failures );
                 std::cerr << msg << std::endl;
             }
         };
@@ -90,27 +95,45 @@ namespace Utility
         FileListProcessor(Handler& handler, std::string const& directory)
         : directory_(directory)
         , processor_(NameMaker().normalize( directory_ ), handler)
+        , batch_(0)
         {}
         
+        // memory-map files for in-place parsing instead of streaming them
+        FileListProcessor& mapped( bool value ) { processor_.mapped( value ); return *this; }
+        
+        // read files 'value' at a time through io_uring, for in-place parsing
+        // (0, or no io_uring: one at a time as configured above)
+        FileListProcessor& batched( size_t value ) { batch_ = value; return *this; }
+        
         template<typename Iterator>
         void do_list( Iterator begin, Iterator const end ) const
         {
+            Batch       _batch(*this);
             for ( ; begin != end; ++begin )
             {
-                processor_( *begin );
+                _batch( *begin );
             }
         }
         
         void do_stream( std::istream& input ) const
         {
+            Batch           _batch(*this);
             std::string     _line;
             
             while ( std::getline( input, _line ) )
             {
-                processor_( _line );
+                _batch( _line );
             }
         }
         
+        // files as a walker (e.g. TreeWalker) finds them
+        template<typename Walker>
+        void do_walk( Walker const& walker ) const
+        {
+            Batch       _batch(*this);
+            walker( [&]( std::string const& key ) { _batch( key ); } );
+        }
+        
         void do_file( std::string const& file ) const
         {
             std::ifstream       _input(file.c_str());
@@ -127,33 +150,147 @@ namespace Utility
         
     private:
         std::string const   directory_;
+        
+        /**
+         * Batch.  One pass over a list: keys are collected and their files
+         * loaded together, then handled in list order; the last, partial
+         * batch on destruction.
+         */
+        class Batch
+        {
+        public:
+            explicit
+            Batch(FileListProcessor const& owner)
+            : owner_(owner)
+            , loader_(owner.batch_ > 0 ? new UringLoader(owner.batch_) : nullptr)
+            , keys_()
+            , names_()
+            , files_()
+            {
+                if ( loader_ and !*loader_ )
+                {
+                    loader_.reset();
+                }
+            }
+            
+            ~Batch()
+            {
+                flush();
+            }
+            
+            void operator() ( std::string const& key )
+            {
+                if ( !loader_ )
+                {
+                    owner_.processor_( key );
+                    return;
+                }
+                keys_.push_back( key );
+                names_.push_back( owner_.processor_.name( key ) );
+                if ( keys_.size() >= owner_.batch_ )
+                {
+                    flush();
+                }
+            }
+            
+        private:
+            void flush()
+            {
+                if ( keys_.empty() )
+                {
+                    return;
+                }
+                loader_->load( names_, files_ );
+                for ( size_t _f(0); _f < keys_.size(); ++_f )
+                {
+                    owner_.processor_( *files_[_f], keys_[_f], names_[_f] );
+                    files_[_f].reset();
+                }
+                keys_.clear();
+                names_.clear();
+                if ( !*loader_ )
+                {
+                    loader_.reset();    // the ring failed: no more batches
+                }
+            }
+            
+            FileListProcessor const&        owner_;
+            std::unique_ptr<UringLoader>    loader_;
+            std::vector<std::string>        keys_;
+            std::vector<std::string>        names_;
+            std::vector<UringLoader::File>  files_;
+        };
+        
         class Processor
         {
         public:
             Processor(NameMaker const& nameMaker, Handler& handler)
             : nameMaker_(nameMaker)
             , handler_(handler)
+            , mapped_(false)
             {}
             
+            void mapped( bool value ) { mapped_ = value; }
+            
+            std::string const name( std::string const& key ) const { return nameMaker_( key ); }
+            
+            // a file loaded already
+            void operator() ( MappedFile& file, std::string const& key, std::string const& name ) const
+            {
+                if ( file )
+                {
+                    handler_( file, key );
+                    return;
+                }
+                ErrorPolicy().on_warning( "Could not open file [" + name + "]!" );
+            }
+            
             void operator() ( std::string const& key ) const
             {
                 std::string const   _name(nameMaker_( key ));
-                std::ifstream       _file(_name.c_str());
                 
-                if ( _file )
+                if ( mapped_ )
                 {
-                    handler_( _file, key );
+                    MappedFile          _file(_name);
+                    if ( _file )
+                    {
+                        handler_( _file, key );
+                        return;
+                    }
                 }
                 else
                 {
-                    ErrorPolicy().on_warning( "Could not open file [" + _name + "]!" );
+                    std::ifstream       _file;
+                    int                 _first;
+                    {
+                        Stats::Scope    _scope(Stats::Open); // with the first read
+                        _file.open( _name.c_str() );
+                        _first = _file.peek();  // once: again, at the end, would fail
+                    }
+                    if ( _file and !Compressed::maybe( _first ) )
+                    {
+                        handler_( _file, key );
+                        return;
+                    }
+                    if ( _file )
+                    {
+                        MappedFile      _image(_name, false); // expanded
+                        if ( _image )
+                        {
+                            handler_( _image, key );
+                            return;
+                        }
+                    }
                 }
+                ErrorPolicy().on_warning( "Could not open file [" + _name + "]!" );
             }
             
         private:
             NameMaker       nameMaker_;
             Handler&        handler_;
+            bool            mapped_;
         }                   processor_;
+        size_t              batch_;
     };
     
 } // namespace Utility
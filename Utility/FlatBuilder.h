@@ -0,0 +1,183 @@
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Utility
+{
+    /**
+     * FlatBuilder.  Just enough of the FlatBuffers wire format to write
+     * small metadata blobs (e.g. Arrow IPC messages) without the flatc
+     * toolchain.  Objects are laid out front to back: each one is written
+     * at the target of an offset field (a Ref) of an object already
+     * written, so a parent precedes its children and every offset points
+     * forward, as the format requires.  Scalars are little-endian and
+     * aligned to their size relative to the start of the buffer.
+     */
+    class FlatBuilder
+    {
+    public:
+        typedef size_t  Ref;    // position of an offset field awaiting its target
+
+        // a table field: a scalar of 1, 2, 4 or 8 bytes, or (size 0)
+        // an offset to an object written later
+        struct Slot
+        {
+            uint16_t    id_;
+            uint8_t     size_;
+            uint64_t    value_;
+        };
+
+        FlatBuilder()
+        : data_(4, 0)
+        {}
+
+        void clear() { data_.assign( 4, 0 ); }
+
+        Ref root() const { return 0; }
+
+        std::vector<uint8_t> const& data() const { return data_; }
+
+        // returns the Refs of the offset slots, in slot order
+        std::vector<Ref> table( Ref at, std::vector<Slot> const& slots )
+        {
+            // widest fields first, after the vtable offset
+            std::vector<size_t>     _order(slots.size());
+            for ( size_t _s(0); _s < slots.size(); ++_s )
+            {
+                _order[_s] = _s;
+            }
+            std::stable_sort( _order.begin(), _order.end(), [&]( size_t a, size_t b ) -> bool
+            {
+                return width( slots[a] ) > width( slots[b] );
+            } );
+            std::vector<uint16_t>   _offsets(slots.size());
+            uint16_t                _size(4);
+            uint16_t                _entries(0);
+            for ( size_t _s : _order )
+            {
+                uint16_t    _width(width( slots[_s] ));
+                _size = (_size + _width - 1) / _width * _width;
+                _offsets[_s] = _size;
+                _size += _width;
+                _entries = std::max<uint16_t>( _entries, slots[_s].id_ + 1 );
+            }
+
+            pad( 2 );
+            size_t const            _vtable(data_.size());
+            put( 4 + 2 * _entries, 2 );
+            put( _size, 2 );
+            for ( uint16_t _id(0); _id < _entries; ++_id )
+            {
+                uint16_t    _offset(0);
+                for ( size_t _s(0); _s < slots.size(); ++_s )
+                {
+                    if ( slots[_s].id_ == _id )
+                    {
+                        _offset = _offsets[_s];
+                    }
+                }
+                put( _offset, 2 );
+            }
+
+            pad( 8 );
+            size_t const            _table(data_.size());
+            point( at );
+            put( _table - _vtable, 4 );
+            std::vector<Ref>        _refs;
+            data_.resize( _table + _size, 0 );
+            for ( size_t _s(0); _s < slots.size(); ++_s )
+            {
+                if ( slots[_s].size_ == 0 )
+                {
+                    _refs.push_back( _table + _offsets[_s] );
+                }
+                else
+                {
+                    poke( _table + _offsets[_s], slots[_s].value_, slots[_s].size_ );
+                }
+            }
+            return _refs;
+        }
+
+        void string( Ref at, std::string const& value )
+        {
+            pad( 4 );
+            point( at );
+            put( value.size(), 4 );
+            data_.insert( data_.end(), value.begin(), value.end() );
+            data_.push_back( 0 );
+        }
+
+        // a vector of tables: returns a Ref per element
+        std::vector<Ref> tables( Ref at, size_t count )
+        {
+            pad( 4 );
+            point( at );
+            put( count, 4 );
+            std::vector<Ref>    _refs;
+            for ( size_t _e(0); _e < count; ++_e )
+            {
+                _refs.push_back( data_.size() );
+                put( 0, 4 );
+            }
+            return _refs;
+        }
+
+        // a vector of structs of two 64-bit integers
+        void pairs( Ref at, std::vector<std::pair<int64_t, int64_t> > const& items )
+        {
+            while ( (data_.size() + 4) % 8 != 0 )
+            {
+                data_.push_back( 0 );
+            }
+            point( at );
+            put( items.size(), 4 );
+            for ( auto const& item : items )
+            {
+                put( item.first, 8 );
+                put( item.second, 8 );
+            }
+        }
+
+    private:
+        static uint16_t width( Slot const& slot )
+        {
+            return slot.size_ == 0 ? 4 : slot.size_;
+        }
+
+        void pad( size_t align )
+        {
+            while ( data_.size() % align != 0 )
+            {
+                data_.push_back( 0 );
+            }
+        }
+
+        void put( uint64_t value, size_t size )
+        {
+            data_.resize( data_.size() + size );
+            poke( data_.size() - size, value, size );
+        }
+
+        void poke( size_t at, uint64_t value, size_t size )
+        {
+            for ( size_t _b(0); _b < size; ++_b )
+            {
+                data_[at + _b] = static_cast<uint8_t>(value >> (8 * _b));
+            }
+        }
+
+        // aims the offset field at the end of the buffer
+        void point( Ref at )
+        {
+            poke( at, data_.size() - at, 4 );
+        }
+
+        std::vector<uint8_t>    data_;
+    };
+
+} // namespace Utility
@@ -0,0 +1,209 @@
+
+#pragma once
+
+#include "Utility/Stats.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace Utility
+{
+    /**
+     * FrameReader.  Splits a stream of many documents (e.g. STDIN fed by a
+     * message bus) into frames, read with plain read() calls into one
+     * buffer that is reused (and grown to the largest frame) throughout:
+     *     Nul      each document ends with a NUL byte, or at end of input;
+     *              frames of white space only are skipped
+     *     Length   each document follows a header line "<bytes>[ <id>]",
+     *              bytes in decimal digits, MaxFrame at most
+     * A frame is returned as a writable range of the buffer, suitable for
+     * in-place parsing, and stays valid until the next call.  Its label
+     * is the header's id if there is one, else its sequence number (from
+     * 1).  next() is false at end of input, or on a malformed or truncated
+     * frame, which error() then describes.
+     */
+    class FrameReader
+    {
+    public:
+        enum Framing { Nul, Length };
+        enum { MaxFrame = 1 << 30 };    // bytes, of a Length frame
+
+        FrameReader(int fd, Framing framing, size_t capacity = 1 << 20)
+        : fd_(fd)
+        , framing_(framing)
+        , buffer_(capacity > 0 ? capacity : 1)
+        , begin_(0)
+        , end_(0)
+        , eof_(false)
+        , seq_(0)
+        , error_()
+        {}
+
+        bool next( char*& data, size_t& size, std::string& label )
+        {
+            Stats::Scope    _scope(Stats::Load);
+            return framing_ == Nul
+                ? next_nul( data, size, label )
+                : next_length( data, size, label )
+                ;
+        }
+
+        std::string const& error() const { return error_; }
+
+    private:
+        bool next_nul( char*& data, size_t& size, std::string& label )
+        {
+            for ( size_t _scanned(0); ; )
+            {
+                char*       _begin(buffer_.data() + begin_);
+                char*       _nul(static_cast<char*>(std::memchr( _begin + _scanned, 0, end_ - begin_ - _scanned )));
+                if ( _nul or (eof_ and end_ > begin_) )
+                {
+                    size_t const    _size(_nul ? _nul - _begin : end_ - begin_);
+                    begin_ += _nul ? _size + 1 : _size;
+                    _scanned = 0;
+                    if ( blank( _begin, _size ) )
+                    {
+                        continue;
+                    }
+                    data  = _begin;
+                    size  = _size;
+                    label = std::to_string( ++seq_ );
+                    return true;
+                }
+                if ( eof_ )
+                {
+                    return false;
+                }
+                _scanned = end_ - begin_;
+                if ( !fill() )
+                {
+                    return false;
+                }
+            }
+        }
+
+        bool next_length( char*& data, size_t& size, std::string& label )
+        {
+            // header
+            char*           _eol(nullptr);
+            for ( size_t _scanned(0); !(_eol = static_cast<char*>(std::memchr( buffer_.data() + begin_ + _scanned, '\n', end_ - begin_ - _scanned ))); )
+            {
+                if ( eof_ )
+                {
+                    return !blank( buffer_.data() + begin_, end_ - begin_ ) and fail( "incomplete frame header" );
+                }
+                _scanned = end_ - begin_;
+                if ( !fill() )
+                {
+                    return false;
+                }
+            }
+            std::string const   _header(buffer_.data() + begin_, _eol);
+            char*               _end(nullptr);
+            errno = 0;
+            unsigned long long  _size(std::strtoull( _header.c_str(), &_end, 10 ));
+            // digits only: strtoull also takes space and a sign
+            if ( !std::isdigit( static_cast<unsigned char>(_header[0]) ) or (*_end != 0 and *_end != ' ' and *_end != '\r') )
+            {
+                return fail( "bad frame header [" + _header + "]" );
+            }
+            if ( errno == ERANGE or _size > MaxFrame )
+            {
+                return fail( "frame too large [" + _header + "]" );
+            }
+            std::string         _id(_end);
+            size_t const        _first(_id.find_first_not_of( " \r" ));
+            _id = _first == std::string::npos ? "" : _id.substr( _first, _id.find_last_not_of( " \r" ) - _first + 1 );
+            begin_ = _eol + 1 - buffer_.data();
+
+            // body
+            while ( end_ - begin_ < _size )
+            {
+                if ( eof_ )
+                {
+                    return fail( "truncated frame [" + _header + "]" );
+                }
+                if ( !fill( _size ) )
+                {
+                    return false;
+                }
+            }
+            data  = buffer_.data() + begin_;
+            size  = _size;
+            begin_ += _size;
+            ++seq_;
+            label = _id.empty() ? std::to_string( seq_ ) : _id;
+            return true;
+        }
+
+        // reads more input after what is pending, making room for at least
+        // 'want' pending bytes: false (with error) on a read error
+        bool fill( size_t want = 0 )
+        {
+            if ( begin_ > 0 )
+            {
+                std::memmove( buffer_.data(), buffer_.data() + begin_, end_ - begin_ );
+                end_ -= begin_;
+                begin_ = 0;
+            }
+            if ( end_ == buffer_.size() or want > buffer_.size() )
+            {
+                buffer_.resize( std::max( buffer_.size() * 2, want ) );
+            }
+            for ( ;; )
+            {
+                ssize_t     _got(::read( fd_, buffer_.data() + end_, buffer_.size() - end_ ));
+                if ( _got > 0 )
+                {
+                    end_ += _got;
+                    return true;
+                }
+                if ( _got == 0 )
+                {
+                    eof_ = true;
+                    return true;
+                }
+                if ( errno != EINTR )
+                {
+                    return fail( std::strerror( errno ) );
+                }
+            }
+        }
+
+        bool fail( std::string const& error )
+        {
+            error_ = error;
+            return false;
+        }
+
+        static bool blank( char const* data, size_t size )
+        {
+            for ( size_t _c(0); _c < size; ++_c )
+            {
+                if ( !std::isspace( static_cast<unsigned char>(data[_c]) ) )
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        int const           fd_;
+        Framing const       framing_;
+        std::vector<char>   buffer_;
+        size_t              begin_;     // pending input is [begin_, end_)
+        size_t              end_;
+        bool                eof_;
+        size_t              seq_;
+        std::string         error_;
+    };
+
+} // namespace Utility
@@ -0,0 +1,102 @@
+
+#pragma once
+
+#include "Utility/StringView.h"
+
+#include <ostream>
+#include <sstream>
+#include <string>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace Utility
+{
+    /**
+     * JsonText.  JSON string literals: quote, backslash and control
+     * characters are escaped, everything else (UTF-8 included) is copied
+     * as it is.  The scan for bytes needing an escape takes 16 bytes at a
+     * time where SSE2 is available, and the clean runs between them are
+     * written in one piece.
+     */
+    struct JsonText
+    {
+        // first byte in [begin, end) that needs an escape, or end
+        static char const* find_special( char const* begin, char const* end )
+        {
+#ifdef __SSE2__
+            __m128i const   _quote(_mm_set1_epi8( '"' ));
+            __m128i const   _backslash(_mm_set1_epi8( '\\' ));
+            __m128i const   _control(_mm_set1_epi8( 0x1F ));
+            for ( ; end - begin >= 16; begin += 16 )
+            {
+                __m128i const   _block(_mm_loadu_si128( reinterpret_cast<__m128i const*>(begin) ));
+                __m128i const   _hits(_mm_or_si128(
+                    _mm_or_si128( _mm_cmpeq_epi8( _block, _quote ), _mm_cmpeq_epi8( _block, _backslash ) ),
+                    _mm_cmpeq_epi8( _mm_max_epu8( _block, _control ), _control ) // unsigned <= 0x1F
+                    ));
+                int const       _mask(_mm_movemask_epi8( _hits ));
+                if ( _mask != 0 )
+                {
+                    return begin + __builtin_ctz( _mask );
+                }
+            }
+#endif
+            while ( begin < end and !special( *begin ) )
+            {
+                ++begin;
+            }
+            return begin;
+        }
+
+        static bool special( char c )
+        {
+            return c == '"' or c == '\\' or static_cast<unsigned char>(c) < 0x20;
+        }
+
+        static void quoted( std::ostream& os, StringView const& value )
+        {
+            static char const   _hex[] = "0123456789abcdef";
+            char const*         _run(value.begin());
+            char const*         _end(value.end());
+            os.put( '"' );
+            for ( ;; )
+            {
+                char const*     _special(find_special( _run, _end ));
+                os.write( _run, _special - _run );
+                if ( _special == _end )
+                {
+                    break;
+                }
+                switch ( *_special )
+                {
+                case '"':  os.write( "\\\"", 2 ); break;
+                case '\\': os.write( "\\\\", 2 ); break;
+                case '\n': os.write( "\\n", 2 ); break;
+                case '\r': os.write( "\\r", 2 ); break;
+                case '\t': os.write( "\\t", 2 ); break;
+                case '\b': os.write( "\\b", 2 ); break;
+                case '\f': os.write( "\\f", 2 ); break;
+                default:
+                    {
+                        char const  _escape[6] = { '\\', 'u', '0', '0', _hex[(*_special >> 4) & 0xF], _hex[*_special & 0xF] };
+                        os.write( _escape, sizeof _escape );
+                    }
+                }
+                _run = _special + 1;
+            }
+            os.put( '"' );
+        }
+
+        // "name": ready to be written ahead of a value
+        static std::string key( StringView const& name )
+        {
+            std::ostringstream  _key;
+            quoted( _key, name );
+            _key << ':';
+            return _key.str();
+        }
+    };
+
+} // namespace Utility
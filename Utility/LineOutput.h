@@ -1,11 +1,22 @@
 
 #pragma once
 
+#include "Utility/CsvText.h"
+#include "Utility/JsonText.h"
+#include "Utility/StringView.h"
+
 #include <iostream>
+#include <iterator>
 #include <string>
+#include <vector>
 
 namespace Utility
 {
+    /**
+     * Line-oriented output formats.  Each row ends with a newline and a
+     * flush request, which an OutputSink applies according to its policy
+     * (a plain std::ostream would write every row through at once).
+     */
     class PrefixedOutput
     {
     public:
@@ -19,7 +30,17 @@ namespace Utility
         , notitle_(false)
         {}
         
-        void operator() ( std::string const& item )
+        // same configuration, different stream
+        PrefixedOutput(PrefixedOutput const& other, std::ostream& os)
+        : os_(os)
+        , source_(other.source_)
+        , separator_(other.separator_)
+        , blanks_(other.blanks_)
+        , only_(other.only_)
+        , notitle_(other.notitle_)
+        {}
+        
+        void operator() ( StringView const& item )
         {
             if ( blanks_ and only_ and item.length() > 0 )
             {
@@ -29,14 +50,14 @@ namespace Utility
             {
                 os_ << source_ << separator_;
             }
-            os_ << item << std::endl;
+            os_ << item << '\n' << std::flush;
         }
         
         void operator() ()
         {
             if ( blanks_ )
             {
-                (*this)( "" );
+                (*this)( StringView() );
             }
         }
     
@@ -78,6 +99,12 @@ namespace Utility
         , separator_(separator)
         {}
         
+        // same configuration, different stream
+        DelimitedOutput(DelimitedOutput const& other, std::ostream& os)
+        : os_(os)
+        , separator_(other.separator_)
+        {}
+        
         DelimitedOutput& separator( std::string const& value )
         {
             separator_.assign( value );
@@ -102,14 +129,14 @@ namespace Utility
             os_ << label;
         }
         
-        void operator() ( std::string const& item )
+        void operator() ( StringView const& item )
         {
             os_ << separator_ << item;
         }
         
         void operator() ()
         {
-            os_ << std::endl;
+            os_ << '\n' << std::flush;
         }
     
     private:
@@ -117,6 +144,9 @@ namespace Utility
         std::string     separator_;
     };
     
+    /**
+     * QuotedOutput.  CSV with every field quoted per RFC 4180 (see CsvText).
+     */
     class QuotedOutput
     {
     public:
@@ -125,6 +155,11 @@ namespace Utility
         : os_(os)
         {}
         
+        // same configuration, different stream
+        QuotedOutput(QuotedOutput const&, std::ostream& os)
+        : os_(os)
+        {}
+        
         template<typename Iterator>
         void operator() ( Iterator begin, Iterator const end )
         {
@@ -140,22 +175,190 @@ namespace Utility
         
         void operator() ( std::string const& label, bool /*tag*/ ) 
         {
-            os_ << "\"" << label << "\"";
+            CsvText::quoted( os_, label );
         }
         
-        void operator() ( std::string const& item )
+        void operator() ( StringView const& item )
         {
-            os_ << ",\"" << item << "\"";
+            os_.put( ',' );
+            CsvText::quoted( os_, item );
         }
         
         void operator() ()
         {
-            os_ << std::endl;
+            os_ << '\n' << std::flush;
         }
     
     private:
         std::ostream&   os_;
     };
     
+    /**
+     * JsonOutput.  JSON Lines: one object per row, keyed by the column
+     * titles (see AgentSet::headers; the first is the source label's),
+     * with null for a column without data.  In grep mode (hits), one
+     * object per match instead, with the source label (unless notitle)
+     * and the value under the names given to keys(); blanks and only
+     * select matches as PrefixedOutput does.
+     */
+    class JsonOutput
+    {
+    public:
+        explicit
+        JsonOutput(std::ostream& os = std::cout)
+        : os_(os)
+        , keys_()
+        , source_()
+        , column_(0)
+        , hits_(false)
+        , blanks_(false)
+        , only_(false)
+        , notitle_(false)
+        {}
+        
+        // same configuration, different stream
+        JsonOutput(JsonOutput const& other, std::ostream& os)
+        : os_(os)
+        , keys_(other.keys_)
+        , source_()
+        , column_(0)
+        , hits_(other.hits_)
+        , blanks_(other.blanks_)
+        , only_(other.only_)
+        , notitle_(other.notitle_)
+        {}
+        
+        // column titles
+        template<typename Iterator>
+        void operator() ( Iterator begin, Iterator const end )
+        {
+            keys_.clear();
+            for ( ; begin != end; ++begin )
+            {
+                keys_.push_back( JsonText::key( *begin ) );
+            }
+        }
+        
+        // grep mode: the source label's name and the value's
+        JsonOutput& keys( std::string const& source, std::string const& value )
+        {
+            std::string const   _keys[] = { source, value };
+            (*this)( std::begin( _keys ), std::end( _keys ) );
+            return *this;
+        }
+        
+        JsonOutput& hits( bool value ) { hits_ = value; return *this; }
+        JsonOutput& blanks( bool value ) { blanks_ = value; return *this; }
+        JsonOutput& only( bool value ) { only_ = value; return *this; }
+        JsonOutput& notitle( bool value ) { notitle_ = value; return *this; }
+        
+        void label( std::string const& label )
+        {
+            if ( hits_ )
+            {
+                source_.assign( label );
+                return;
+            }
+            os_.put( '{' );
+            column_ = 0;
+            value( label );
+        }
+        
+        void item( StringView const& item )
+        {
+            if ( hits_ )
+            {
+                if ( !(blanks_ and only_ and item.length() > 0) )
+                {
+                    hit( &item );
+                }
+                return;
+            }
+            os_.put( ',' );
+            value( item );
+        }
+        
+        void no_data()
+        {
+            if ( hits_ )
+            {
+                if ( blanks_ )
+                {
+                    hit( nullptr );
+                }
+                return;
+            }
+            os_.put( ',' );
+            value( nullptr );
+        }
+        
+        void end()
+        {
+            if ( !hits_ )
+            {
+                os_ << "}\n" << std::flush;
+            }
+        }
+    
+    private:
+        void value( StringView const& item )
+        {
+            key();
+            JsonText::quoted( os_, item );
+        }
+        
+        void value( std::nullptr_t )
+        {
+            key();
+            os_.write( "null", 4 );
+        }
+        
+        void key()
+        {
+            if ( column_ < keys_.size() )
+            {
+                os_ << keys_[column_];
+            }
+            else
+            {
+                os_ << '"' << column_ << "\":"; // more values than titles
+            }
+            ++column_;
+        }
+        
+        void hit( StringView const* item )
+        {
+            os_.put( '{' );
+            column_ = 0;
+            if ( notitle_ )
+            {
+                ++column_;
+            }
+            else
+            {
+                value( source_ );
+                os_.put( ',' );
+            }
+            if ( item )
+            {
+                value( *item );
+            }
+            else
+            {
+                value( nullptr );
+            }
+            os_ << "}\n" << std::flush;
+        }
+        
+        std::ostream&               os_;
+        std::vector<std::string>    keys_;      // rendered, with the colon
+        std::string                 source_;
+        size_t                      column_;
+        bool                        hits_;
+        bool                        blanks_;
+        bool                        only_;
+        bool                        notitle_;
+    };
+    
 } // namespace Utility
 
@@ -0,0 +1,203 @@
+
+#pragma once
+
+#include "Utility/Compressed.h"
+#include "Utility/Stats.h"
+
+#include <cerrno>
+#include <istream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Utility
+{
+    /**
+     * MappedFile.  Writable private (copy-on-write) memory image of a file,
+     * suitable for in-place parsing.  Regular files are mapped; pipes,
+     * special files and anything mmap() refuses are read() into a heap
+     * buffer instead (as are all files when 'map' is false, so that the
+     * I/O is done by the constructor rather than on first touch).  Files
+     * and buffers of gzip or zstd content are expanded into a heap buffer
+     * in their place (see Compressed); content in memory owned elsewhere
+     * is taken as it is.  Check with operator bool before use.
+     */
+    class MappedFile
+    {
+    public:
+        explicit
+        MappedFile(std::string const& name, bool map = true)
+        : map_(nullptr)
+        , view_(nullptr)
+        , size_(0)
+        , heap_()
+        , ok_(false)
+        {
+            int     _fd(open( name ));
+            if ( _fd >= 0 )
+            {
+                load( _fd, map );
+                ::close( _fd );
+            }
+        }
+
+        // borrowed descriptor (e.g. STDIN): not closed here
+        explicit
+        MappedFile(int fd, bool map = true)
+        : map_(nullptr)
+        , view_(nullptr)
+        , size_(0)
+        , heap_()
+        , ok_(false)
+        {
+            load( fd, map );
+        }
+
+        // content already read (e.g. by UringLoader): size bytes of heap
+        MappedFile(std::vector<char>&& heap, size_t size)
+        : map_(nullptr)
+        , view_(nullptr)
+        , size_(size)
+        , heap_(std::move( heap ))
+        , ok_(expand())
+        {}
+
+        // the rest of a stream (e.g. std::cin, once peeked at)
+        explicit
+        MappedFile(std::istream& input)
+        : map_(nullptr)
+        , view_(nullptr)
+        , size_(0)
+        , heap_((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>())
+        , ok_(false)
+        {
+            size_ = heap_.size();
+            ok_ = !input.bad() and expand();
+        }
+
+        // content in memory owned elsewhere (e.g. by FrameReader)
+        MappedFile(char* data, size_t size)
+        : map_(nullptr)
+        , view_(data)
+        , size_(size)
+        , heap_()
+        , ok_(true)
+        {}
+
+        ~MappedFile()
+        {
+            if ( map_ )
+            {
+                ::munmap( map_, size_ );
+            }
+        }
+
+        explicit operator bool() const { return ok_; }
+
+        char* data() { return map_ ? static_cast<char*>(map_) : view_ ? view_ : heap_.data(); }
+        size_t size() const { return size_; }
+        bool mapped() const { return map_ != nullptr; }
+
+    private:
+        MappedFile(MappedFile const&) = delete;
+        MappedFile& operator= ( MappedFile const& ) = delete;
+
+        void load( int fd, bool map )
+        {
+            ok_ = take( fd, map ) and expand();
+        }
+
+        static int open( std::string const& name )
+        {
+            Stats::Scope    _scope(Stats::Open);
+            return ::open( name.c_str(), O_RDONLY | O_CLOEXEC );
+        }
+
+        bool take( int fd, bool map )
+        {
+            Stats::Scope    _scope(Stats::Load);
+            struct stat     _st;
+            if ( ::fstat( fd, &_st ) != 0 )
+            {
+                return false;
+            }
+            // empty regular files may still have content (e.g. /proc)
+            if ( map and S_ISREG(_st.st_mode) and _st.st_size > 0 )
+            {
+                void*   _map(::mmap( nullptr, _st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 ));
+                if ( _map != MAP_FAILED )
+                {
+                    ::madvise( _map, _st.st_size, MADV_SEQUENTIAL );
+                    map_  = _map;
+                    size_ = _st.st_size;
+                    return true;
+                }
+            }
+            return read( fd, S_ISREG(_st.st_mode) ? _st.st_size : 0 );
+        }
+
+        // compressed content replaced by its expansion: false if corrupt
+        bool expand()
+        {
+            Compressed::Format const    _format(Compressed::format( data(), size_ ));
+            if ( _format == Compressed::None )
+            {
+                return true;
+            }
+            Stats::Scope        _scope(Stats::Load);
+            std::vector<char>   _heap;
+            size_t              _size;
+            if ( !Compressed::expand( _format, data(), size_, _heap, _size ) )
+            {
+                return false;
+            }
+            if ( map_ )
+            {
+                ::munmap( map_, size_ );
+                map_ = nullptr;
+            }
+            heap_.swap( _heap );
+            size_ = _size;
+            return true;
+        }
+
+        bool read( int fd, size_t hint )
+        {
+            heap_.resize( hint > 0 ? hint + 1 : 64 * 1024 );
+            for ( ;; )
+            {
+                if ( size_ == heap_.size() )
+                {
+                    heap_.resize( heap_.size() * 2 );
+                }
+                ssize_t     _got(::read( fd, heap_.data() + size_, heap_.size() - size_ ));
+                if ( _got == 0 )
+                {
+                    return true;
+                }
+                if ( _got < 0 )
+                {
+                    if ( errno == EINTR )
+                    {
+                        continue;
+                    }
+                    return false;
+                }
+                size_ += _got;
+            }
+        }
+
+        void*               map_;
+        char*               view_;
+        size_t              size_;
+        std::vector<char>   heap_;
+        bool                ok_;
+    };
+
+} // namespace Utility
@@ -0,0 +1,202 @@
+
+#pragma once
+
+#include "Utility/Stats.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace Utility
+{
+    /**
+     * OutputSink.  std::ostream over a file descriptor (STDOUT, or a named
+     * file) with a large user-space buffer that is handed to write(2) in
+     * whole blocks.  A flush() on the stream is only a request: the policy
+     * decides whether it writes anything.
+     *     AtEnd     write when the buffer fills, and when the sink closes
+     *     Bytes     also at a flush request once 'amount' bytes are held
+     *     Interval  also at a flush request 'amount' ms after the last write
+     * The LineOutput classes request a flush at the end of every row.
+     * Write errors (e.g. a closed pipe) set badbit.
+     */
+    class OutputSink
+    : public std::ostream
+    {
+    public:
+        enum Policy { AtEnd, Bytes, Interval };
+
+        // empty path: STDOUT
+        explicit
+        OutputSink(std::string const& path = "", size_t capacity = 1 << 20)
+        : std::ostream(nullptr)
+        , buffer_(open( path ), !path.empty(), capacity)
+        {
+            rdbuf( &buffer_ );
+            if ( !buffer_.ok() )
+            {
+                setstate( std::ios_base::badbit );
+            }
+        }
+
+        ~OutputSink()
+        {
+            buffer_.close();
+        }
+
+        OutputSink& policy( Policy policy, size_t amount = 0 )
+        {
+            buffer_.policy( policy, amount );
+            return *this;
+        }
+
+        // for an interactive reader: every row as soon as it is complete
+        bool interactive() const { return ::isatty( buffer_.fd() ) == 1; }
+
+    private:
+        OutputSink(OutputSink const&) = delete;
+        OutputSink& operator= ( OutputSink const& ) = delete;
+
+        static int open( std::string const& path )
+        {
+            return path.empty()
+                ? STDOUT_FILENO
+                : ::open( path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666 )
+                ;
+        }
+
+        class Buffer
+        : public std::streambuf
+        {
+        public:
+            Buffer(int fd, bool owned, size_t capacity)
+            : fd_(fd)
+            , owned_(owned)
+            , data_(capacity > 0 ? capacity : 1)
+            , policy_(AtEnd)
+            , amount_(0)
+            , last_(std::chrono::steady_clock::now())
+            , ok_(fd >= 0)
+            {
+                setp( data_.data(), data_.data() + data_.size() );
+            }
+
+            bool ok() const { return ok_; }
+            int fd() const { return fd_; }
+
+            void policy( Policy policy, size_t amount )
+            {
+                policy_ = policy;
+                amount_ = amount;
+            }
+
+            void close()
+            {
+                drain();
+                if ( owned_ and fd_ >= 0 )
+                {
+                    ::close( fd_ );
+                }
+                fd_ = -1;
+            }
+
+        protected:
+            int_type overflow( int_type c ) override
+            {
+                if ( !drain() )
+                {
+                    return traits_type::eof();
+                }
+                if ( !traits_type::eq_int_type( c, traits_type::eof() ) )
+                {
+                    *pptr() = traits_type::to_char_type( c );
+                    pbump( 1 );
+                }
+                return traits_type::not_eof( c );
+            }
+
+            std::streamsize xsputn( char const* s, std::streamsize n ) override
+            {
+                if ( n > epptr() - pptr() )
+                {
+                    if ( !drain() )
+                    {
+                        return 0;
+                    }
+                    if ( static_cast<size_t>(n) >= data_.size() )
+                    {
+                        return put( s, n ) ? n : 0; // too big to be worth copying
+                    }
+                }
+                std::memcpy( pptr(), s, n );
+                pbump( static_cast<int>(n) );
+                return n;
+            }
+
+            int sync() override
+            {
+                switch ( policy_ )
+                {
+                case Bytes:
+                    if ( static_cast<size_t>(pptr() - pbase()) >= amount_ )
+                    {
+                        return drain() ? 0 : -1;
+                    }
+                    break;
+                case Interval:
+                    if ( std::chrono::steady_clock::now() - last_ >= std::chrono::milliseconds(amount_) )
+                    {
+                        return drain() ? 0 : -1;
+                    }
+                    break;
+                case AtEnd:
+                    break;
+                }
+                return ok_ ? 0 : -1;
+            }
+
+        private:
+            bool drain()
+            {
+                bool    _ok(put( pbase(), pptr() - pbase() ));
+                setp( data_.data(), data_.data() + data_.size() );
+                last_ = std::chrono::steady_clock::now();
+                return _ok;
+            }
+
+            bool put( char const* s, size_t n )
+            {
+                Stats::Scope    _scope(Stats::Output);
+                while ( ok_ and n > 0 )
+                {
+                    ssize_t     _done(::write( fd_, s, n ));
+                    if ( _done < 0 )
+                    {
+                        ok_ = errno == EINTR;
+                        continue;
+                    }
+                    s += _done;
+                    n -= _done;
+                }
+                return ok_;
+            }
+
+            int                                     fd_;
+            bool                                    owned_;
+            std::vector<char>                       data_;
+            Policy                                  policy_;
+            size_t                                  amount_;
+            std::chrono::steady_clock::time_point   last_;
+            bool                                    ok_;
+        };
+
+        Buffer      buffer_;
+    };
+
+} // namespace Utility
@@ -0,0 +1,290 @@
+
+#pragma once
+
+#include "Utility/FileListProcessor.h"
+#include "Utility/BoundedQueue.h"
+#include "Utility/ResultCache.h"
+
+#include <map>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Utility
+{
+    /**
+     * OrderedWriter.  Reorder stage: accepts numbered buffers in any order
+     * and writes them to the output stream strictly in sequence.  The
+     * window bounds how far producers may run ahead of the writer.
+     */
+    class OrderedWriter
+    {
+    public:
+        OrderedWriter(std::ostream& os, size_t window)
+        : os_(os)
+        , window_(window > 0 ? window : 1)
+        , next_(0)
+        , busy_(false)
+        , pending_()
+        , mutex_()
+        , room_()
+        {}
+
+        // blocks until seq falls inside the reorder window
+        void admit( size_t seq )
+        {
+            std::unique_lock<std::mutex>    _lock(mutex_);
+            room_.wait( _lock, [&]() -> bool { return seq < next_ + window_; } );
+        }
+
+        void post( size_t seq, std::string&& text )
+        {
+            std::unique_lock<std::mutex>    _lock(mutex_);
+            pending_.insert( std::make_pair( seq, std::move( text ) ) );
+            if ( busy_ )
+            {
+                return; // the draining thread will pick it up
+            }
+            busy_ = true;
+            for ( auto _it(pending_.begin()); _it != pending_.end() and _it->first == next_; _it = pending_.begin() )
+            {
+                std::string     _text(std::move( _it->second ));
+                pending_.erase( _it );
+                _lock.unlock();
+                {
+                    Stats::Scope    _scope(Stats::Output);
+                    os_.write( _text.data(), _text.size() );
+                    os_.flush(); // a request: the sink's policy decides
+                }
+                _lock.lock();
+                ++next_;
+                room_.notify_all();
+            }
+            busy_ = false;
+        }
+
+        void flush()
+        {
+            os_.flush();
+        }
+
+    private:
+        std::ostream&                   os_;
+        size_t const                    window_;
+        size_t                          next_;
+        bool                            busy_;
+        std::map<size_t, std::string>   pending_;
+        std::mutex                      mutex_;
+        std::condition_variable         room_;
+    };
+
+    /**
+     * ParallelListProcessor.  Same interface as FileListProcessor, but files
+     * are opened and handled by a pool of worker threads.  The client is
+     * called concurrently, as client( input, key, os ), and must emit into
+     * the supplied stream only; each file's output is buffered and written
+     * in input-list order, so the result matches a sequential run.
+     * With a cache, the output of files unchanged since it was recorded
+     * is replayed instead, and the output of the others is recorded when
+     * the client reports success.
+     */
+    template<typename Client, typename ErrorPolicy = LogOnly>
+    class ParallelListProcessor
+    {
+    public:
+        ParallelListProcessor(Client& client, std::string const& directory, size_t jobs, std::ostream& os = std::cout)
+        : nameMaker_(NameMaker().normalize( directory ))
+        , client_(client)
+        , jobs_(jobs > 0 ? jobs : 1)
+        , os_(os)
+        , mapped_(false)
+        , cache_(nullptr)
+        {}
+        
+        // memory-map files for in-place parsing instead of streaming them
+        ParallelListProcessor& mapped( bool value ) { mapped_ = value; return *this; }
+        
+        ParallelListProcessor& cache( ResultCache* value ) { cache_ = value; return *this; }
+
+        template<typename Iterator>
+        void do_list( Iterator begin, Iterator const end ) const
+        {
+            Run     _run(*this);
+            for ( ; begin != end; ++begin )
+            {
+                _run( *begin );
+            }
+        }
+
+        void do_stream( std::istream& input ) const
+        {
+            Run             _run(*this);
+            std::string     _line;
+
+            while ( std::getline( input, _line ) )
+            {
+                _run( _line );
+            }
+        }
+
+        // files as a walker (e.g. TreeWalker) finds them
+        template<typename Walker>
+        void do_walk( Walker const& walker ) const
+        {
+            Run     _run(*this);
+            walker( [&]( std::string const& key ) { _run( key ); } );
+        }
+
+        void do_file( std::string const& file ) const
+        {
+            std::ifstream       _input(file.c_str());
+
+            if ( _input )
+            {
+                do_stream( _input );
+            }
+            else
+            {
+                ErrorPolicy().on_warning( "Problem opening list file [" + file + "]!" );
+            }
+        }
+
+    private:
+        typedef std::pair<size_t, std::string>  Job;
+
+        /**
+         * Run.  One pass over a list: workers start on construction and
+         * are drained and joined on destruction.
+         */
+        class Run
+        {
+        public:
+            explicit
+            Run(ParallelListProcessor const& owner)
+            : owner_(owner)
+            , queue_(owner.jobs_ * 4)
+            , writer_(owner.os_, owner.jobs_ * 16)
+            , seq_(0)
+            , workers_()
+            {
+                for ( size_t _i(0); _i < owner_.jobs_; ++_i )
+                {
+                    workers_.push_back( std::thread(&Run::work, this) );
+                }
+            }
+
+            ~Run()
+            {
+                queue_.close();
+                for ( auto& worker : workers_ )
+                {
+                    worker.join();
+                }
+                writer_.flush();
+            }
+
+            void operator() ( std::string const& key )
+            {
+                writer_.admit( seq_ );
+                queue_.push( Job(seq_++, key) );
+            }
+
+        private:
+            void work()
+            {
+                Job                     _job;
+                std::ostringstream      _buffer;
+
+                while ( queue_.pop( _job ) )
+                {
+                    _buffer.str( "" );
+                    _buffer.clear();
+                    process( _job.second, _buffer );
+                    writer_.post( _job.first, _buffer.str() );
+                }
+            }
+
+            void process( std::string const& key, std::ostringstream& os ) const
+            {
+                typedef ResultCache::Stamp  Stamp;
+                std::string const   _name(owner_.nameMaker_( key ));
+                Stamp               _stamp;
+                bool const          _cached(owner_.cache_ and Stamp::of( _name, _stamp ));
+
+                if ( _cached and owner_.cache_->replay( key, _name, _stamp, os ) )
+                {
+                    return;
+                }
+                if ( open( _name, key, os ) and _cached )
+                {
+                    owner_.cache_->store( key, _name, _stamp, os.str() );
+                }
+            }
+
+            bool open( std::string const& name, std::string const& key, std::ostream& os ) const
+            {
+                if ( owner_.mapped_ )
+                {
+                    MappedFile          _file(name);
+                    if ( _file )
+                    {
+                        return handle( _file, key, os );
+                    }
+                }
+                else
+                {
+                    std::ifstream       _file;
+                    int                 _first;
+                    {
+                        Stats::Scope    _scope(Stats::Open); // with the first read
+                        _file.open( name.c_str() );
+                        _first = _file.peek();  // once: again, at the end, would fail
+                    }
+                    if ( _file and !Compressed::maybe( _first ) )
+                    {
+                        return handle( _file, key, os );
+                    }
+                    if ( _file )
+                    {
+                        MappedFile      _image(name, false); // expanded
+                        if ( _image )
+                        {
+                            return handle( _image, key, os );
+                        }
+                    }
+                }
+                ErrorPolicy().on_warning( "Could not open file [" + name + "]!" );
+                return false;
+            }
+
+            template<typename Input>
+            bool handle( Input& input, std::string const& key, std::ostream& os ) const
+            {
+                try
+                {
+                    return owner_.client_( input, key, os );
+                }
+                catch ( std::exception& ex )
+                {
+                    ErrorPolicy().on_warning( key + ": " + ex.what() );
+                    return false;
+                }
+            }
+
+            ParallelListProcessor const&    owner_;
+            BoundedQueue<Job>               queue_;
+            OrderedWriter                   writer_;
+            size_t                          seq_;
+            std::vector<std::thread>        workers_;
+        };
+
+        NameMaker const             nameMaker_;
+        Client&                     client_;
+        size_t const                jobs_;
+        std::ostream&               os_;
+        bool                        mapped_;
+        ResultCache*                cache_;
+    };
+
+} // namespace Utility
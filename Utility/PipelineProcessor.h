@@ -0,0 +1,359 @@
+
+#pragma once
+
+#include "Utility/FileListProcessor.h"
+#include "Utility/ParallelListProcessor.h"
+#include "Utility/UringLoader.h"
+
+#include <deque>
+#include <iomanip>
+#include <memory>
+
+#include <fcntl.h>
+
+namespace Utility
+{
+    /**
+     * PipelineProcessor.  Same interface as FileListProcessor, with the
+     * work split into stages joined by bounded queues, so that reading,
+     * parsing, evaluation and output overlap:
+     *     read      the calling thread keeps the next 'prefetch' files
+     *               open, with readahead requested, and reads the oldest
+     *               into memory; or, with uring(), loads them a batch of
+     *               'prefetch' at a time through io_uring
+     *     parse     'jobs' threads build a Document in place over each
+     *               buffer: Document(char*, size), throwing on failure
+     *     evaluate  'jobs' threads call client( document, key, os ), to
+     *               emit into the supplied stream only
+     *     write     one thread writes each file's output in input-list
+     *               order
+     * With report(), the counters of the queues between the stages are
+     * written to STDERR at the end of each list: the queue in front of
+     * the slowest stage tends to be full, the ones after it empty.
+     */
+    template<typename Client, typename Document, typename ErrorPolicy = LogOnly>
+    class PipelineProcessor
+    {
+    public:
+        PipelineProcessor(Client& client, std::string const& directory, size_t jobs, std::ostream& os = std::cout)
+        : nameMaker_(NameMaker().normalize( directory ))
+        , client_(client)
+        , jobs_(jobs > 0 ? jobs : 1)
+        , os_(os)
+        , prefetch_(8)
+        , report_(false)
+        , uring_(false)
+        {}
+
+        // files opened ahead of the one being read
+        PipelineProcessor& prefetch( size_t value ) { prefetch_ = value > 0 ? value : 1; return *this; }
+
+        PipelineProcessor& report( bool value ) { report_ = value; return *this; }
+
+        // falls back to the read-ahead above when io_uring is unavailable
+        PipelineProcessor& uring( bool value ) { uring_ = value; return *this; }
+
+        template<typename Iterator>
+        void do_list( Iterator begin, Iterator const end ) const
+        {
+            Run     _run(*this);
+            for ( ; begin != end; ++begin )
+            {
+                _run( *begin );
+            }
+        }
+
+        void do_stream( std::istream& input ) const
+        {
+            Run             _run(*this);
+            std::string     _line;
+
+            while ( std::getline( input, _line ) )
+            {
+                _run( _line );
+            }
+        }
+
+        // files as a walker (e.g. TreeWalker) finds them
+        template<typename Walker>
+        void do_walk( Walker const& walker ) const
+        {
+            Run     _run(*this);
+            walker( [&]( std::string const& key ) { _run( key ); } );
+        }
+
+        void do_file( std::string const& file ) const
+        {
+            std::ifstream       _input(file.c_str());
+
+            if ( _input )
+            {
+                do_stream( _input );
+            }
+            else
+            {
+                ErrorPolicy().on_warning( "Problem opening list file [" + file + "]!" );
+            }
+        }
+
+    private:
+        // one file on its way through the stages; a file that cannot be
+        // opened or parsed goes on without content, to keep its place
+        struct Item
+        {
+            size_t                          seq_;
+            std::string                     key_;
+            int                             fd_;
+            std::unique_ptr<MappedFile>     file_;
+            std::unique_ptr<Document const> doc_;
+        };
+
+        typedef std::unique_ptr<Item>           Job;
+        typedef std::pair<size_t, std::string>  Text;
+
+        /**
+         * Run.  One pass over a list: stage threads start on construction
+         * and are drained and joined in order on destruction.
+         */
+        class Run
+        {
+        public:
+            explicit
+            Run(PipelineProcessor const& owner)
+            : owner_(owner)
+            , window_()
+            , loaded_(owner.prefetch_)
+            , parsed_(owner.jobs_ * 2)
+            , written_(owner.jobs_ * 4)
+            , writer_(owner.os_, owner.jobs_ * 16 + owner.prefetch_)
+            , seq_(0)
+            , parsers_()
+            , evaluators_()
+            , output_()
+            , loader_(owner.uring_ ? new UringLoader(owner.prefetch_) : nullptr)
+            {
+                if ( loader_ and !*loader_ )
+                {
+                    loader_.reset();
+                }
+                for ( size_t _i(0); _i < owner_.jobs_; ++_i )
+                {
+                    parsers_.push_back( std::thread(&Run::parse, this) );
+                    evaluators_.push_back( std::thread(&Run::evaluate, this) );
+                }
+                output_ = std::thread(&Run::write, this);
+            }
+
+            ~Run()
+            {
+                if ( loader_ and !window_.empty() )
+                {
+                    load();
+                }
+                while ( !window_.empty() )
+                {
+                    read();
+                }
+                loaded_.close();
+                join( parsers_ );
+                parsed_.close();
+                join( evaluators_ );
+                written_.close();
+                output_.join();
+                writer_.flush();
+                if ( owner_.report_ )
+                {
+                    report();
+                }
+            }
+
+            // the read stage, on the calling thread
+            void operator() ( std::string const& key )
+            {
+                writer_.admit( seq_ );
+                Job         _job(new Item{ seq_++, key, -1, nullptr, nullptr });
+                if ( loader_ )
+                {
+                    window_.push_back( std::move( _job ) );
+                    if ( window_.size() >= owner_.prefetch_ )
+                    {
+                        load();
+                    }
+                    return;
+                }
+                std::string const   _name(owner_.nameMaker_( key ));
+                {
+                    Stats::Scope    _scope(Stats::Open);
+                    _job->fd_ = ::open( _name.c_str(), O_RDONLY | O_CLOEXEC );
+                    if ( _job->fd_ >= 0 )
+                    {
+                        ::posix_fadvise( _job->fd_, 0, 0, POSIX_FADV_WILLNEED );
+                    }
+                }
+                if ( _job->fd_ < 0 )
+                {
+                    ErrorPolicy().on_warning( "Could not open file [" + _name + "]!" );
+                }
+                window_.push_back( std::move( _job ) );
+                if ( window_.size() > owner_.prefetch_ )
+                {
+                    read();
+                }
+            }
+
+        private:
+            void read()
+            {
+                Job         _job(std::move( window_.front() ));
+                window_.pop_front();
+                if ( _job->fd_ >= 0 )
+                {
+                    _job->file_.reset( new MappedFile(_job->fd_, false) );
+                    ::close( _job->fd_ );
+                    if ( !*_job->file_ )
+                    {
+                        ErrorPolicy().on_warning( "Could not read file [" + owner_.nameMaker_( _job->key_ ) + "]!" );
+                        _job->file_.reset();
+                    }
+                }
+                loaded_.push( std::move( _job ) );
+            }
+
+            // the whole window, as one io_uring batch
+            void load()
+            {
+                std::vector<std::string>        _names;
+                for ( auto const& job : window_ )
+                {
+                    _names.push_back( owner_.nameMaker_( job->key_ ) );
+                }
+                std::vector<UringLoader::File>  _files;
+                loader_->load( _names, _files );
+                for ( size_t _f(0); _f < _files.size(); ++_f )
+                {
+                    Job         _job(std::move( window_.front() ));
+                    window_.pop_front();
+                    if ( *_files[_f] )
+                    {
+                        _job->file_ = std::move( _files[_f] );
+                    }
+                    else
+                    {
+                        ErrorPolicy().on_warning( "Could not open file [" + _names[_f] + "]!" );
+                    }
+                    loaded_.push( std::move( _job ) );
+                }
+                if ( !*loader_ )
+                {
+                    loader_.reset();    // the ring failed: no more windows
+                }
+            }
+
+            void parse()
+            {
+                Job         _job;
+                while ( loaded_.pop( _job ) )
+                {
+                    if ( _job->file_ )
+                    {
+                        try
+                        {
+                            _job->doc_.reset( new Document(_job->file_->data(), _job->file_->size()) );
+                        }
+                        catch ( std::exception& ex )
+                        {
+                            ErrorPolicy().on_warning( _job->key_ + ": " + ex.what() );
+                        }
+                    }
+                    parsed_.push( std::move( _job ) );
+                }
+            }
+
+            void evaluate()
+            {
+                Job                     _job;
+                std::ostringstream      _buffer;
+                while ( parsed_.pop( _job ) )
+                {
+                    _buffer.str( "" );
+                    _buffer.clear();
+                    if ( _job->doc_ )
+                    {
+                        try
+                        {
+                            owner_.client_( *_job->doc_, _job->key_, _buffer );
+                        }
+                        catch ( std::exception& ex )
+                        {
+                            ErrorPolicy().on_warning( _job->key_ + ": " + ex.what() );
+                        }
+                    }
+                    size_t const    _seq(_job->seq_);
+                    _job.reset(); // document and buffer go here, not in the writer
+                    written_.push( Text(_seq, _buffer.str()) );
+                }
+            }
+
+            void write()
+            {
+                Text        _text;
+                while ( written_.pop( _text ) )
+                {
+                    writer_.post( _text.first, std::move( _text.second ) );
+                }
+            }
+
+            static void join( std::vector<std::thread>& threads )
+            {
+                for ( auto& thread : threads )
+                {
+                    thread.join();
+                }
+            }
+
+            template<typename Queue>
+            static void line( std::ostream& os, char const* name, Queue const& queue )
+            {
+                auto const  _stats(queue.stats());
+                os  << std::setw( 10 ) << name
+                    << std::setw( 10 ) << _stats.items_
+                    << std::setw( 8 ) << std::fixed << std::setprecision( 2 ) << _stats.mean()
+                    << std::setw( 6 ) << _stats.peak_
+                    << std::setw( 8 ) << _stats.full_
+                    << std::setw( 8 ) << _stats.empty_
+                    << '\n';
+            }
+
+            void report() const
+            {
+                std::ostringstream  _report;
+                _report << "     queue     items    mean  peak    full   empty\n";
+                line( _report, "read>", loaded_ );
+                line( _report, "parse>", parsed_ );
+                line( _report, "evaluate>", written_ );
+                std::cerr << _report.str() << std::flush;
+            }
+
+            PipelineProcessor const&    owner_;
+            std::deque<Job>             window_;    // opened, being read ahead
+            BoundedQueue<Job>           loaded_;
+            BoundedQueue<Job>           parsed_;
+            BoundedQueue<Text>          written_;
+            OrderedWriter               writer_;
+            size_t                      seq_;
+            std::vector<std::thread>    parsers_;
+            std::vector<std::thread>    evaluators_;
+            std::thread                 output_;
+            std::unique_ptr<UringLoader>    loader_;
+        };
+
+        NameMaker const     nameMaker_;
+        Client&             client_;
+        size_t const        jobs_;
+        std::ostream&       os_;
+        size_t              prefetch_;
+        bool                report_;
+        bool                uring_;
+    };
+
+} // namespace Utility
@@ -0,0 +1,260 @@
+
+#pragma once
+
+#include "Utility/FileListProcessor.h" // NameMaker
+#include "Utility/MappedFile.h"
+#include "Utility/StringView.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Utility
+{
+    /**
+     * ResultCache.  The output of an earlier run for each input file, to
+     * be replayed while the file is unchanged.  The signature stands for
+     * everything else the output depends on (expressions, modes, format
+     * options): each signature has a cache file of its own in the cache
+     * directory, named by its hash, and holding the signature itself to
+     * rule out collisions.  Entries are identified by the file's key and
+     * name, and are valid while the file's size, inode, mtime and ctime
+     * are as they were.  The file of an earlier run is mapped and its
+     * entries replayed from there; save() writes the entries of the
+     * current run (hits and newly stored) to a new file, which replaces
+     * the old one.  The format is that of the machine (byte order, sizes).
+     * replay() and store() may be called concurrently.
+     */
+    class ResultCache
+    {
+    public:
+        // what identifies a version of a file
+        struct Stamp
+        {
+            uint64_t    size_;
+            uint64_t    inode_;
+            int64_t     mtime_; // ns
+            int64_t     ctime_; // ns
+
+            bool operator== ( Stamp const& other ) const
+            {
+                return size_ == other.size_ and inode_ == other.inode_
+                    and mtime_ == other.mtime_ and ctime_ == other.ctime_;
+            }
+
+            // false if there is no such file
+            static bool of( std::string const& name, Stamp& stamp )
+            {
+                struct stat     _st;
+                if ( ::stat( name.c_str(), &_st ) != 0 )
+                {
+                    return false;
+                }
+                stamp.size_  = _st.st_size;
+                stamp.inode_ = _st.st_ino;
+                stamp.mtime_ = _st.st_mtim.tv_sec * 1000000000LL + _st.st_mtim.tv_nsec;
+                stamp.ctime_ = _st.st_ctim.tv_sec * 1000000000LL + _st.st_ctim.tv_nsec;
+                return true;
+            }
+        };
+
+        ResultCache(std::string const& directory, std::string const& signature)
+        : file_(NameMaker().normalize( directory )( hash( signature ) + ".xpc" ))
+        , signature_(signature)
+        , image_(file_)
+        , entries_()
+        , fresh_()
+        , hits_(0)
+        , misses_(0)
+        , mutex_()
+        {
+            ::mkdir( directory.c_str(), 0777 ); // if need be
+            load();
+        }
+
+        // writes the output recorded for an unchanged file to os
+        bool replay( std::string const& key, std::string const& name, Stamp const& stamp, std::ostream& os )
+        {
+            auto    _entry(entries_.find( id( key, name ) ));
+            if ( _entry == entries_.end() or !(_entry->second.stamp_ == stamp) )
+            {
+                std::lock_guard<std::mutex>     _lock(mutex_);
+                ++misses_;
+                return false;
+            }
+            {
+                std::lock_guard<std::mutex>     _lock(mutex_);
+                _entry->second.used_ = true;
+                ++hits_;
+            }
+            os << _entry->second.text_;
+            return true;
+        }
+
+        void store( std::string const& key, std::string const& name, Stamp const& stamp, std::string const& text )
+        {
+            std::lock_guard<std::mutex>     _lock(mutex_);
+            fresh_.push_back( Fresh{ id( key, name ), stamp, text } );
+        }
+
+        size_t hits() const { return hits_; }
+        size_t misses() const { return misses_; }
+
+        std::string const& file() const { return file_; }
+
+        // replaces the cache file with the entries of this run
+        bool save() const
+        {
+            std::string const   _temp(file_ + ".tmp" + std::to_string( ::getpid() ));
+            {
+                std::ofstream       _os(_temp.c_str(), std::ios::binary);
+                put( _os, uint64_t(Magic) );
+                put( _os, StringView(signature_) );
+                for ( auto const& entry : entries_ )
+                {
+                    if ( entry.second.used_ )
+                    {
+                        put( _os, StringView(entry.first), entry.second.stamp_, entry.second.text_ );
+                    }
+                }
+                for ( auto const& entry : fresh_ )
+                {
+                    put( _os, StringView(entry.id_), entry.stamp_, StringView(entry.text_) );
+                }
+                if ( _os.flush() )
+                {
+                    _os.close();
+                    if ( std::rename( _temp.c_str(), file_.c_str() ) == 0 )
+                    {
+                        return true;
+                    }
+                }
+            }
+            std::remove( _temp.c_str() );
+            return false;
+        }
+
+    private:
+        ResultCache(ResultCache const&) = delete;
+        ResultCache& operator= ( ResultCache const& ) = delete;
+
+        enum : uint64_t { Magic = 0x3168636163707821ULL }; // "!xpcach1"
+
+        struct Entry
+        {
+            Stamp       stamp_;
+            StringView  text_;  // in image_
+            bool        used_;
+        };
+
+        struct Fresh
+        {
+            std::string id_;
+            Stamp       stamp_;
+            std::string text_;
+        };
+
+        static std::string id( std::string const& key, std::string const& name )
+        {
+            return key + '\0' + name;
+        }
+
+        // FNV-1a, in hex
+        static std::string hash( std::string const& text )
+        {
+            uint64_t    _hash(0xcbf29ce484222325ULL);
+            for ( unsigned char _c : text )
+            {
+                _hash = (_hash ^ _c) * 0x100000001b3ULL;
+            }
+            char        _hex[17];
+            std::snprintf( _hex, sizeof _hex, "%016llx", static_cast<unsigned long long>(_hash) );
+            return _hex;
+        }
+
+        // an unreadable or foreign file is taken as empty
+        void load()
+        {
+            if ( !image_ )
+            {
+                return;
+            }
+            char const*         _at(image_.data());
+            char const* const   _end(_at + image_.size());
+            uint64_t            _magic;
+            StringView          _signature;
+            if ( !get( _at, _end, _magic ) or _magic != Magic
+                or !get( _at, _end, _signature ) or _signature.str() != signature_ )
+            {
+                return;
+            }
+            StringView          _id;
+            Entry               _entry{ Stamp(), StringView(), false };
+            while ( get( _at, _end, _id ) and get( _at, _end, _entry.stamp_ ) and get( _at, _end, _entry.text_ ) )
+            {
+                entries_[_id.str()] = _entry;
+            }
+        }
+
+        template<typename T>
+        static bool get( char const*& at, char const* end, T& value )
+        {
+            if ( static_cast<size_t>(end - at) < sizeof value )
+            {
+                return false;
+            }
+            std::memcpy( &value, at, sizeof value );
+            at += sizeof value;
+            return true;
+        }
+
+        static bool get( char const*& at, char const* end, StringView& value )
+        {
+            uint64_t    _size;
+            if ( !get( at, end, _size ) or static_cast<uint64_t>(end - at) < _size )
+            {
+                return false;
+            }
+            value = StringView(at, _size);
+            at += _size;
+            return true;
+        }
+
+        template<typename T>
+        static void put( std::ostream& os, T const& value )
+        {
+            os.write( reinterpret_cast<char const*>(&value), sizeof value );
+        }
+
+        static void put( std::ostream& os, StringView const& value )
+        {
+            put( os, static_cast<uint64_t>(value.size()) );
+            os.write( value.data(), value.size() );
+        }
+
+        static void put( std::ostream& os, StringView const& id, Stamp const& stamp, StringView const& text )
+        {
+            put( os, id );
+            put( os, stamp );
+            put( os, text );
+        }
+
+        std::string const                           file_;
+        std::string const                           signature_;
+        MappedFile                                  image_;
+        std::unordered_map<std::string, Entry>      entries_;
+        std::vector<Fresh>                          fresh_;
+        size_t                                      hits_;
+        size_t                                      misses_;
+        std::mutex                                  mutex_;
+    };
+
+} // namespace Utility
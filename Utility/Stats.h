@@ -0,0 +1,191 @@
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+
+#include <sys/resource.h>
+#include <time.h>
+
+namespace Utility
+{
+    /**
+     * Stats.  Run-wide counters and time per stage, for --stats.  A Scope
+     * charges the time between its construction and destruction, on the
+     * calling thread, to its stage, less that of Scopes nested within it
+     * (e.g. output written while evaluating), so that each moment of a
+     * thread's time goes to one stage at most; wall and CPU (thread) time
+     * are taken at each stage boundary.  With several threads, stage times
+     * are summed over the threads, and may add up to more than the run's
+     * wall time.  Until enable() is called, a Scope and count() cost one
+     * test of a pointer each.
+     */
+    class Stats
+    {
+    public:
+        enum Stage { None, Open, Load, Parse, Evaluate, Output, Stages };
+        enum Counter { Documents, Bytes, Rows, Failures, Stopped, Skipped, Counters };
+
+        static Stats* active() { return instance(); }
+
+        static void enable()
+        {
+            static Stats    _stats;
+            instance() = &_stats;
+        }
+
+        static void count( Counter counter, uint64_t amount = 1 )
+        {
+            if ( Stats* _stats = active() )
+            {
+                _stats->counters_[counter].fetch_add( amount, std::memory_order_relaxed );
+            }
+        }
+
+        class Scope
+        {
+        public:
+            explicit
+            Scope(Stage stage)
+            : stats_(active())
+            , outer_(None)
+            {
+                if ( stats_ )
+                {
+                    outer_ = stats_->enter( stage );
+                }
+            }
+
+            ~Scope()
+            {
+                if ( stats_ )
+                {
+                    stats_->enter( outer_ );
+                }
+            }
+
+        private:
+            Scope(Scope const&) = delete;
+            Scope& operator= ( Scope const& ) = delete;
+
+            Stats*      stats_;
+            Stage       outer_;
+        };
+
+        void report( std::ostream& os ) const
+        {
+            static char const* const    _names[Stages] = { "", "open", "load", "parse", "evaluate", "output" };
+            double const    _wall(seconds( now( CLOCK_MONOTONIC ) - start_ ));
+            rusage          _usage;
+            ::getrusage( RUSAGE_SELF, &_usage );
+            double const    _user(_usage.ru_utime.tv_sec + _usage.ru_utime.tv_usec / 1e6);
+            double const    _sys(_usage.ru_stime.tv_sec + _usage.ru_stime.tv_usec / 1e6);
+            uint64_t const  _docs(counters_[Documents]);
+            uint64_t const  _bytes(counters_[Bytes]);
+            uint64_t        _staged(0);
+            for ( int _s(Open); _s < Stages; ++_s )
+            {
+                _staged += wall_[_s];
+            }
+            char            _line[160];
+            std::snprintf( _line, sizeof _line, "stats: %llu documents, %.1f MB, %llu rows, %llu failures\n",
+                static_cast<unsigned long long>(_docs), _bytes / 1e6,
+                static_cast<unsigned long long>(counters_[Rows].load()),
+                static_cast<unsigned long long>(counters_[Failures].load()) );
+            os << _line;
+            if ( counters_[Stopped] > 0 )
+            {
+                std::snprintf( _line, sizeof _line, "stats: %llu documents read in part (--early), %.1f MB skipped\n",
+                    static_cast<unsigned long long>(counters_[Stopped].load()), counters_[Skipped] / 1e6 );
+                os << _line;
+            }
+            std::snprintf( _line, sizeof _line, "stats: wall %.3f s, cpu %.3f s (user %.3f, sys %.3f), peak RSS %.1f MB\n",
+                _wall, _user + _sys, _user, _sys, _usage.ru_maxrss / 1024.0 );
+            os << _line;
+            std::snprintf( _line, sizeof _line, "stats: %.1f docs/s, %.1f MB/s\n",
+                _wall > 0 ? _docs / _wall : 0.0, _wall > 0 ? _bytes / 1e6 / _wall : 0.0 );
+            os << _line;
+            os << "stats: stage       wall s    cpu s   share\n";
+            for ( int _s(Open); _s < Stages; ++_s )
+            {
+                std::snprintf( _line, sizeof _line, "stats: %-9s %8.3f %8.3f  %5.1f%%\n", _names[_s],
+                    seconds( wall_[_s] ), seconds( cpu_[_s] ), _staged > 0 ? wall_[_s] * 100.0 / _staged : 0.0 );
+                os << _line;
+            }
+            os.flush();
+        }
+
+    private:
+        Stats()
+        : start_(now( CLOCK_MONOTONIC ))
+        {
+            for ( int _s(0); _s < Stages; ++_s )
+            {
+                wall_[_s] = 0;
+                cpu_[_s] = 0;
+            }
+            for ( int _c(0); _c < Counters; ++_c )
+            {
+                counters_[_c] = 0;
+            }
+        }
+
+        Stats(Stats const&) = delete;
+        Stats& operator= ( Stats const& ) = delete;
+
+        static Stats*& instance()
+        {
+            static Stats*   _instance(nullptr);
+            return _instance;
+        }
+
+        // the calling thread's current stage, since when
+        struct Thread
+        {
+            Stage       stage_;
+            uint64_t    wall_;
+            uint64_t    cpu_;
+        };
+
+        static Thread& thread()
+        {
+            thread_local Thread     _thread{ None, 0, 0 };
+            return _thread;
+        }
+
+        static uint64_t now( clockid_t clock )
+        {
+            timespec    _ts;
+            ::clock_gettime( clock, &_ts );
+            return _ts.tv_sec * 1000000000ULL + _ts.tv_nsec;
+        }
+
+        static double seconds( uint64_t ns ) { return ns / 1e9; }
+
+        // closes the current stage's interval: returns that stage
+        Stage enter( Stage stage )
+        {
+            Thread&         _thread(thread());
+            uint64_t const  _wall(now( CLOCK_MONOTONIC ));
+            uint64_t const  _cpu(now( CLOCK_THREAD_CPUTIME_ID ));
+            Stage const     _outer(_thread.stage_);
+            if ( _outer != None )
+            {
+                wall_[_outer].fetch_add( _wall - _thread.wall_, std::memory_order_relaxed );
+                cpu_[_outer].fetch_add( _cpu - _thread.cpu_, std::memory_order_relaxed );
+            }
+            _thread.stage_ = stage;
+            _thread.wall_  = _wall;
+            _thread.cpu_   = _cpu;
+            return _outer;
+        }
+
+        uint64_t const          start_;
+        std::atomic<uint64_t>   wall_[Stages];  // ns
+        std::atomic<uint64_t>   cpu_[Stages];
+        std::atomic<uint64_t>   counters_[Counters];
+    };
+
+} // namespace Utility
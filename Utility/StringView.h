@@ -0,0 +1,60 @@
+
+#pragma once
+
+#include <cstring>
+#include <ostream>
+#include <string>
+
+namespace Utility
+{
+    /**
+     * StringView.  Non-owning pointer and length, for passing character
+     * data that already lives somewhere else (e.g. in a DOM) without
+     * copying it.  The viewed data must outlive the view.  Converts to
+     * std::string where a copy is actually wanted.
+     */
+    class StringView
+    {
+    public:
+        StringView()
+        : data_("")
+        , size_(0)
+        {}
+
+        StringView(char const* data)
+        : data_(data ? data : "")
+        , size_(data ? std::strlen( data ) : 0)
+        {}
+
+        StringView(char const* data, size_t size)
+        : data_(data)
+        , size_(size)
+        {}
+
+        StringView(std::string const& value)
+        : data_(value.data())
+        , size_(value.size())
+        {}
+
+        char const* data() const { return data_; }
+        size_t size() const { return size_; }
+        size_t length() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+        char const* begin() const { return data_; }
+        char const* end() const { return data_ + size_; }
+
+        std::string str() const { return std::string(data_, size_); }
+        operator std::string() const { return str(); }
+
+    private:
+        char const*     data_;
+        size_t          size_;
+    };
+
+    inline std::ostream& operator<< ( std::ostream& os, StringView const& value )
+    {
+        return os.write( value.data(), value.size() );
+    }
+
+} // namespace Utility
@@ -0,0 +1,276 @@
+
+#pragma once
+
+#include "Utility/FileListProcessor.h"
+#include "Utility/BoundedQueue.h"
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace Utility
+{
+    /**
+     * TreeWalker.  Input source for the list processors' do_walk(): finds
+     * the files under a root directory without a find(1) in front.  Each
+     * directory is listed with getdents64 in large blocks and opened with
+     * openat relative to a directory descriptor, and each regular file
+     * whose name matches one of the patterns (fnmatch globs, e.g. "*.xml";
+     * no patterns: every file) is handed on as soon as it is found, as its
+     * path relative to the root.  Symbolic links are followed to files but
+     * not to directories.
+     * With threads(n) > 1, n threads list directories concurrently, which
+     * pays where each listing waits on storage (e.g. network file systems);
+     * files are still handed on from the calling thread, but the order in
+     * which they are found varies from run to run.
+     */
+    template<typename ErrorPolicy = LogOnly>
+    class TreeWalker
+    {
+    public:
+        explicit
+        TreeWalker(std::string const& root)
+        : root_(root)
+        , patterns_()
+        , threads_(1)
+        {}
+
+        TreeWalker& patterns( std::vector<std::string> const& value ) { patterns_ = value; return *this; }
+        TreeWalker& threads( size_t value ) { threads_ = value > 0 ? value : 1; return *this; }
+
+        // calls emit( path ) for each file found
+        template<typename Emit>
+        void operator() ( Emit emit ) const
+        {
+            int const   _root(::open( root_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC ));
+            if ( _root < 0 )
+            {
+                ErrorPolicy().on_warning( "Could not open directory [" + root_ + "]!" );
+                return;
+            }
+            if ( threads_ > 1 )
+            {
+                parallel( _root, emit );
+            }
+            else
+            {
+                Buffer      _buffer(BufferSize);
+                walk( _root, "", emit, _buffer );
+            }
+            ::close( _root );
+        }
+
+    private:
+        typedef std::vector<char>   Buffer;
+
+        enum { BufferSize = 64 * 1024 };
+
+        // as the kernel writes them
+        struct Entry
+        {
+            uint64_t        d_ino;
+            int64_t         d_off;
+            unsigned short  d_reclen;
+            unsigned char   d_type;
+            char            d_name[1];
+        };
+
+        // depth first, each directory's files before its subdirectories,
+        // which are opened relative to it
+        template<typename Emit>
+        void walk( int fd, std::string const& prefix, Emit& emit, Buffer& buffer ) const
+        {
+            std::vector<std::string>    _subdirs;
+            list( fd, prefix, emit, _subdirs, buffer );
+            for ( auto const& name : _subdirs )
+            {
+                int const   _sub(::openat( fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC ));
+                if ( _sub < 0 )
+                {
+                    ErrorPolicy().on_warning( "Could not open directory [" + path( prefix + name ) + "]!" );
+                    continue;
+                }
+                walk( _sub, prefix + name + '/', emit, buffer );
+                ::close( _sub );
+            }
+        }
+
+        // emits the files of one directory, and collects its subdirectories
+        template<typename Emit>
+        void list( int fd, std::string const& prefix, Emit& emit, std::vector<std::string>& subdirs, Buffer& buffer ) const
+        {
+            for ( ;; )
+            {
+                long const  _got(::syscall( SYS_getdents64, fd, buffer.data(), buffer.size() ));
+                if ( _got <= 0 )
+                {
+                    if ( _got < 0 )
+                    {
+                        ErrorPolicy().on_warning( "Could not read directory [" + path( prefix ) + "]!" );
+                    }
+                    return;
+                }
+                for ( long _at(0); _at < _got; )
+                {
+                    Entry const*    _entry(reinterpret_cast<Entry const*>(buffer.data() + _at));
+                    _at += _entry->d_reclen;
+                    char const*     _name(_entry->d_name);
+                    if ( _name[0] == '.' and (_name[1] == 0 or (_name[1] == '.' and _name[2] == 0)) )
+                    {
+                        continue;
+                    }
+                    unsigned char   _type(_entry->d_type);
+                    if ( _type == DT_UNKNOWN or _type == DT_LNK )
+                    {
+                        struct stat     _st;
+                        if ( ::fstatat( fd, _name, &_st, 0 ) != 0 )
+                        {
+                            continue;   // e.g. a dangling link
+                        }
+                        _type = S_ISREG(_st.st_mode) ? DT_REG
+                              : S_ISDIR(_st.st_mode) and _type == DT_UNKNOWN ? DT_DIR
+                              : DT_UNKNOWN
+                              ;
+                    }
+                    if ( _type == DT_DIR )
+                    {
+                        subdirs.push_back( _name );
+                    }
+                    else
+                    if ( _type == DT_REG and matches( _name ) )
+                    {
+                        emit( prefix + _name );
+                    }
+                }
+            }
+        }
+
+        bool matches( char const* name ) const
+        {
+            if ( patterns_.empty() )
+            {
+                return true;
+            }
+            for ( auto const& pattern : patterns_ )
+            {
+                if ( ::fnmatch( pattern.c_str(), name, 0 ) == 0 )
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        std::string const path( std::string const& relative ) const
+        {
+            return relative.empty() ? root_ : NameMaker().normalize( root_ )( relative );
+        }
+
+        /**
+         * Shared.  Work of a parallel walk: directories waiting to be listed
+         * (as prefixes relative to the root), and the files found, for the
+         * calling thread.  The walk is over when no directory is waiting
+         * and none is being listed.
+         */
+        struct Shared
+        {
+            explicit
+            Shared(size_t threads)
+            : dirs_(1, std::string())
+            , busy_(0)
+            , live_(threads)
+            , mutex_()
+            , change_()
+            , files_(1024)
+            {}
+
+            std::vector<std::string>    dirs_;
+            size_t                      busy_;
+            size_t                      live_;
+            std::mutex                  mutex_;
+            std::condition_variable     change_;
+            BoundedQueue<std::string>   files_;
+        };
+
+        template<typename Emit>
+        void parallel( int root, Emit& emit ) const
+        {
+            Shared                      _shared(threads_);
+            std::vector<std::thread>    _threads;
+            for ( size_t _t(0); _t < threads_; ++_t )
+            {
+                _threads.push_back( std::thread(&TreeWalker::work, this, root, std::ref( _shared )) );
+            }
+            std::string                 _file;
+            while ( _shared.files_.pop( _file ) )
+            {
+                emit( _file );
+            }
+            for ( auto& thread : _threads )
+            {
+                thread.join();
+            }
+        }
+
+        void work( int root, Shared& shared ) const
+        {
+            Buffer                          _buffer(BufferSize);
+            auto                            _emit([&]( std::string&& file ) { shared.files_.push( std::move( file ) ); });
+            for ( ;; )
+            {
+                std::string                 _prefix;
+                {
+                    std::unique_lock<std::mutex>    _lock(shared.mutex_);
+                    shared.change_.wait( _lock, [&]() -> bool { return !shared.dirs_.empty() or shared.busy_ == 0; } );
+                    if ( shared.dirs_.empty() )
+                    {
+                        break;
+                    }
+                    _prefix = std::move( shared.dirs_.back() );
+                    shared.dirs_.pop_back();
+                    ++shared.busy_;
+                }
+                std::vector<std::string>    _subdirs;
+                int const   _fd(::openat( root, _prefix.empty() ? "." : _prefix.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC ));
+                if ( _fd < 0 )
+                {
+                    ErrorPolicy().on_warning( "Could not open directory [" + path( _prefix ) + "]!" );
+                }
+                else
+                {
+                    list( _fd, _prefix, _emit, _subdirs, _buffer );
+                    ::close( _fd );
+                }
+                {
+                    std::unique_lock<std::mutex>    _lock(shared.mutex_);
+                    for ( auto& name : _subdirs )
+                    {
+                        shared.dirs_.push_back( _prefix + name + '/' );
+                    }
+                    --shared.busy_;
+                }
+                shared.change_.notify_all();
+            }
+            std::unique_lock<std::mutex>    _lock(shared.mutex_);
+            if ( --shared.live_ == 0 )
+            {
+                shared.files_.close();
+            }
+        }
+
+        std::string const           root_;
+        std::vector<std::string>    patterns_;
+        size_t                      threads_;
+    };
+
+} // namespace Utility
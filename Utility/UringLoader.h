@@ -0,0 +1,372 @@
+
+#pragma once
+
+#include "Utility/MappedFile.h"
+#include "Utility/Stats.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace Utility
+{
+    /**
+     * UringLoader.  Reads whole files into memory a batch at a time through
+     * io_uring, so that a batch of N files costs a handful of system calls
+     * instead of five per file (open, fstat, two reads, close):
+     *     1. statx and openat for every file, submitted together
+     *     2. a read of each regular file at the size statx gave
+     *     3. close of every descriptor
+     * Each step is one io_uring_enter() while the batch fits in the ring.
+     * Files the batch could not deal with (open failures, special files,
+     * sizes that changed under the read) are loaded the plain way, so a
+     * file fails exactly when MappedFile(name, false) would.  The ring is
+     * set up through the raw system calls (no liburing); check operator
+     * bool, and load files the plain way when it is false: kernels before
+     * 5.6 lack the operations, and io_uring may be disabled or filtered.
+     * After a failure of the ring itself, it is false for good, and
+     * load() loads every file the plain way.
+     */
+    class UringLoader
+    {
+    public:
+        typedef std::unique_ptr<MappedFile>     File;
+
+        explicit
+        UringLoader(size_t batch)
+        : ring_(-1)
+        , sq_(nullptr)
+        , sqSize_(0)
+        , cq_(nullptr)
+        , cqSize_(0)
+        , sqes_(nullptr)
+        , sqesSize_(0)
+        , broken_(false)
+        {
+            setup( batch * 2 < 4096 ? batch * 2 : 4096 );
+        }
+
+        ~UringLoader()
+        {
+            if ( sqes_ )
+            {
+                ::munmap( sqes_, sqesSize_ );
+            }
+            if ( cq_ and cq_ != sq_ )
+            {
+                ::munmap( cq_, cqSize_ );
+            }
+            if ( sq_ )
+            {
+                ::munmap( sq_, sqSize_ );
+            }
+            if ( ring_ >= 0 )
+            {
+                ::close( ring_ );
+            }
+        }
+
+        explicit operator bool() const { return sqes_ != nullptr and !broken_; }
+
+        // files[i] gets the content of names[i]: check it with operator bool
+        void load( std::vector<std::string> const& names, std::vector<File>& files )
+        {
+            Stats::Scope            _scope(Stats::Load); // opening included
+            size_t const            _count(names.size());
+            std::vector<Entry>      _entries(_count);
+
+            // 1. statx and openat, two operations per file
+            run( _count * 2, [&]( size_t op, io_uring_sqe& sqe )
+            {
+                Entry&      _entry(_entries[op / 2]);
+                sqe.fd   = AT_FDCWD;
+                sqe.addr = reinterpret_cast<uintptr_t>(names[op / 2].c_str());
+                if ( op % 2 == 0 )
+                {
+                    sqe.opcode      = IORING_OP_STATX;
+                    sqe.len         = STATX_TYPE | STATX_SIZE;
+                    sqe.off         = reinterpret_cast<uintptr_t>(&_entry.stat_);
+                }
+                else
+                {
+                    sqe.opcode      = IORING_OP_OPENAT;
+                    sqe.open_flags  = O_RDONLY | O_CLOEXEC;
+                }
+            }, [&]( size_t op, int result )
+            {
+                Entry&      _entry(_entries[op / 2]);
+                if ( op % 2 == 0 )
+                {
+                    _entry.stated_ = result == 0;
+                }
+                else
+                {
+                    _entry.fd_ = result;
+                }
+            } );
+
+            // 2. one read per regular file, asking for a byte more than its
+            // size to see that it has not grown
+            std::vector<size_t>     _reads;
+            for ( size_t _f(0); _f < _count; ++_f )
+            {
+                Entry&      _entry(_entries[_f]);
+                if ( _entry.fd_ >= 0 and _entry.stated_ and S_ISREG(_entry.stat_.stx_mode)
+                    and _entry.stat_.stx_size > 0 and _entry.stat_.stx_size < (1u << 30) )
+                {
+                    _entry.heap_.resize( _entry.stat_.stx_size + 1 );
+                    _reads.push_back( _f );
+                }
+            }
+            run( _reads.size(), [&]( size_t op, io_uring_sqe& sqe )
+            {
+                Entry&      _entry(_entries[_reads[op]]);
+                sqe.opcode  = IORING_OP_READ;
+                sqe.fd      = _entry.fd_;
+                sqe.addr    = reinterpret_cast<uintptr_t>(_entry.heap_.data());
+                sqe.len     = _entry.heap_.size();
+                sqe.off     = 0;
+            }, [&]( size_t op, int result )
+            {
+                Entry&      _entry(_entries[_reads[op]]);
+                _entry.read_ = result == static_cast<int>(_entry.stat_.stx_size);
+            } );
+
+            files.resize( _count );
+            std::vector<int>        _closes;
+            for ( size_t _f(0); _f < _count; ++_f )
+            {
+                Entry&      _entry(_entries[_f]);
+                if ( _entry.read_ )
+                {
+                    files[_f].reset( new MappedFile(std::move( _entry.heap_ ), _entry.stat_.stx_size) );
+                }
+                else
+                if ( _entry.fd_ >= 0 )
+                {
+                    // reads at offset 0 leave the file position alone
+                    files[_f].reset( new MappedFile(_entry.fd_, false) );
+                }
+                else
+                {
+                    files[_f].reset( new MappedFile(names[_f], false) );
+                }
+                if ( _entry.fd_ >= 0 )
+                {
+                    _closes.push_back( _entry.fd_ );
+                }
+            }
+
+            // 3. close, the plain way for any the ring did not complete
+            run( _closes.size(), [&]( size_t op, io_uring_sqe& sqe )
+            {
+                sqe.opcode  = IORING_OP_CLOSE;
+                sqe.fd      = _closes[op];
+            }, [&]( size_t op, int )
+            {
+                _closes[op] = -1;
+            } );
+            for ( int _fd : _closes )
+            {
+                if ( _fd >= 0 )
+                {
+                    ::close( _fd );
+                }
+            }
+        }
+
+    private:
+        UringLoader(UringLoader const&) = delete;
+        UringLoader& operator= ( UringLoader const& ) = delete;
+
+        struct Entry
+        {
+            Entry()
+            : stat_()
+            , stated_(false)
+            , fd_(-1)
+            , heap_()
+            , read_(false)
+            {}
+
+            struct statx        stat_;
+            bool                stated_;
+            int                 fd_;
+            std::vector<char>   heap_;
+            bool                read_;
+        };
+
+        void setup( unsigned entries )
+        {
+            io_uring_params     _params;
+            std::memset( &_params, 0, sizeof _params );
+            ring_ = ::syscall( __NR_io_uring_setup, entries, &_params );
+            if ( ring_ < 0 or !supported() )
+            {
+                return;
+            }
+            sqSize_ = _params.sq_off.array + _params.sq_entries * sizeof (unsigned);
+            cqSize_ = _params.cq_off.cqes + _params.cq_entries * sizeof (io_uring_cqe);
+            if ( _params.features & IORING_FEAT_SINGLE_MMAP )
+            {
+                sqSize_ = cqSize_ = std::max( sqSize_, cqSize_ );
+            }
+            sq_ = map( sqSize_, IORING_OFF_SQ_RING );
+            cq_ = _params.features & IORING_FEAT_SINGLE_MMAP ? sq_ : map( cqSize_, IORING_OFF_CQ_RING );
+            if ( !sq_ or !cq_ )
+            {
+                return;
+            }
+            char* const     _sq(static_cast<char*>(sq_));
+            char* const     _cq(static_cast<char*>(cq_));
+            sqHead_     = reinterpret_cast<unsigned*>(_sq + _params.sq_off.head);
+            sqTail_     = reinterpret_cast<unsigned*>(_sq + _params.sq_off.tail);
+            sqMask_     = *reinterpret_cast<unsigned*>(_sq + _params.sq_off.ring_mask);
+            sqArray_    = reinterpret_cast<unsigned*>(_sq + _params.sq_off.array);
+            sqEntries_  = _params.sq_entries;
+            cqHead_     = reinterpret_cast<unsigned*>(_cq + _params.cq_off.head);
+            cqTail_     = reinterpret_cast<unsigned*>(_cq + _params.cq_off.tail);
+            cqMask_     = *reinterpret_cast<unsigned*>(_cq + _params.cq_off.ring_mask);
+            cqes_       = reinterpret_cast<io_uring_cqe*>(_cq + _params.cq_off.cqes);
+            cqEntries_  = _params.cq_entries;
+            sqesSize_   = _params.sq_entries * sizeof (io_uring_sqe);
+            sqes_       = static_cast<io_uring_sqe*>(map( sqesSize_, IORING_OFF_SQES ));
+        }
+
+        // all four operations, or none
+        bool supported() const
+        {
+            size_t const        _ops(256);
+            std::vector<char>   _buffer(sizeof (io_uring_probe) + _ops * sizeof (io_uring_probe_op), 0);
+            io_uring_probe*     _probe(reinterpret_cast<io_uring_probe*>(_buffer.data()));
+            if ( ::syscall( __NR_io_uring_register, ring_, IORING_REGISTER_PROBE, _probe, _ops ) < 0 )
+            {
+                return false;
+            }
+            for ( unsigned _op : { IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE } )
+            {
+                if ( _op > _probe->last_op or !(_probe->ops[_op].flags & IO_URING_OP_SUPPORTED) )
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void* map( size_t size, off_t offset ) const
+        {
+            void*   _map(::mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_, offset ));
+            return _map == MAP_FAILED ? nullptr : _map;
+        }
+
+        /**
+         * Submits 'count' operations, as many at a time as the rings take:
+         * fill( op, sqe ) prepares operation 'op' in a cleared entry, and
+         * done( op, result ) gets its completion.  On a failure of the
+         * ring itself the remaining operations go without completion,
+         * which load() treats as failed, and the ring is given up.
+         */
+        template<typename Fill, typename Done>
+        void run( size_t count, Fill fill, Done done )
+        {
+            size_t      _next(0);
+            size_t      _flight(0);
+            size_t      _done(0);
+            while ( !broken_ and _done < count )
+            {
+                unsigned        _tail(*sqTail_); // only this thread moves it
+                unsigned const  _head(__atomic_load_n( sqHead_, __ATOMIC_ACQUIRE ));
+                for ( ; _next < count and _flight < cqEntries_ and _tail - _head < sqEntries_; ++_next, ++_flight, ++_tail )
+                {
+                    unsigned const  _index(_tail & sqMask_);
+                    io_uring_sqe&   _sqe(sqes_[_index]);
+                    std::memset( &_sqe, 0, sizeof _sqe );
+                    fill( _next, _sqe );
+                    _sqe.user_data = _next;
+                    sqArray_[_index] = _index;
+                }
+                __atomic_store_n( sqTail_, _tail, __ATOMIC_RELEASE );
+
+                unsigned const  _submit(_tail - __atomic_load_n( sqHead_, __ATOMIC_ACQUIRE ));
+                if ( !enter( _submit ) )
+                {
+                    abandon( _flight, done );
+                    return;
+                }
+                size_t const    _reaped(reap( done ));
+                _done   += _reaped;
+                _flight -= _reaped;
+            }
+        }
+
+        /**
+         * Gives the ring up: takes back the entries the kernel has not
+         * taken, and waits for the operations it has, whose buffers and
+         * descriptors are load()'s (their completions still go to done).
+         */
+        template<typename Done>
+        void abandon( size_t flight, Done& done )
+        {
+            broken_ = true;
+            unsigned const  _head(__atomic_load_n( sqHead_, __ATOMIC_ACQUIRE ));
+            flight -= *sqTail_ - _head;
+            __atomic_store_n( sqTail_, _head, __ATOMIC_RELEASE );
+            while ( (flight -= reap( done )) > 0 and enter( 0 ) )
+            {}
+        }
+
+        // submits and waits for a completion: false on a failure of the
+        // ring itself (rather than an interruption, or a full ring)
+        bool enter( unsigned submit ) const
+        {
+            return ::syscall( __NR_io_uring_enter, ring_, submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0 ) >= 0
+                or errno == EINTR or errno == EAGAIN or errno == EBUSY;
+        }
+
+        // passes the completions there are to done: how many
+        template<typename Done>
+        size_t reap( Done& done )
+        {
+            unsigned        _cqHead(*cqHead_);
+            unsigned const  _cqTail(__atomic_load_n( cqTail_, __ATOMIC_ACQUIRE ));
+            size_t          _reaped(0);
+            for ( ; _cqHead != _cqTail; ++_cqHead, ++_reaped )
+            {
+                io_uring_cqe const&     _cqe(cqes_[_cqHead & cqMask_]);
+                done( _cqe.user_data, _cqe.res );
+            }
+            __atomic_store_n( cqHead_, _cqHead, __ATOMIC_RELEASE );
+            return _reaped;
+        }
+
+        int             ring_;
+        void*           sq_;
+        size_t          sqSize_;
+        void*           cq_;
+        size_t          cqSize_;
+        io_uring_sqe*   sqes_;
+        size_t          sqesSize_;
+        unsigned*       sqHead_;
+        unsigned*       sqTail_;
+        unsigned        sqMask_;
+        unsigned*       sqArray_;
+        unsigned        sqEntries_;
+        unsigned*       cqHead_;
+        unsigned*       cqTail_;
+        unsigned        cqMask_;
+        io_uring_cqe*   cqes_;
+        unsigned        cqEntries_;
+        bool            broken_;
+    };
+
+} // namespace Utility
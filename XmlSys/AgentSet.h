@@ -1,6 +1,7 @@
 
 #pragma once
 #include "XmlSys/XpathAgent.h"
+#include "XmlSys/SetMatcher.h"
 
 #include <vector>
 #include <istream>
@@ -125,6 +126,7 @@ namespace XmlSys
         AgentSet(std::istream& source, FormatParser const& parser = FormatParser())
         : header_()
         , agents_()
+        , matcher_()
         {
             SetLoader<AgentSet>(*this, parser)( source );
         }
@@ -133,6 +135,7 @@ namespace XmlSys
         AgentSet(Iterator begin, Iterator const end, FormatParser const& parser = FormatParser())
         : header_()
         , agents_()
+        , matcher_()
         {
             SetLoader<AgentSet>(*this, parser)( begin, end );
         }
@@ -163,6 +166,12 @@ namespace XmlSys
             return agents_.size();
         }
         
+        // all columns, evaluated in one pass per context node
+        SetMatcher const& matcher() const { return matcher_; }
+        
+        // see XpathAgent::deferred()
+        bool deferrable() const { return matcher_.deferrable(); }
+        
     private:
         void add_title( std::string const& title )
         {
@@ -173,10 +182,12 @@ namespace XmlSys
         {
             header_.push_back( title );
             agents_.push_back( XpathAgent(xpath) );
+            matcher_.add( agents_.back() );
         }
         
         std::vector<std::string>        header_;
         std::vector<XpathAgent>         agents_;
+        SetMatcher                      matcher_;
     };
     
 } // namespace XmlSys
@@ -0,0 +1,248 @@
+
+#pragma once
+
+#include "XmlSys/AgentSet.h"
+#include "XmlSys/SetMatcher.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace XmlSys
+{
+    /**
+     * ColumnProfile.  The columns of an AgentSet evaluated one at a time,
+     * each by a SetMatcher of its own, so that the cost of every column
+     * can be told apart: time, evaluations, hits and (for columns the walk
+     * evaluates) elements looked at.  The values are those of the shared
+     * walk, so output is unchanged; the run is slower, since each column
+     * walks the context subtree by itself.  Counters are shared by all
+     * threads; a Scan is per thread (see local()).
+     */
+    class ColumnProfile
+    {
+    public:
+        explicit
+        ColumnProfile(AgentSet const& agents)
+        : titles_()
+        , xpaths_()
+        , matchers_()
+        , counters_(agents.matcher().size())
+        , id_(next_id())
+        {
+            Titles      _titles{ titles_ };
+            agents.headers( _titles );
+            matchers_.reserve( counters_.size() );
+            agents.apply( [&]( XpathAgent const& agent ) -> void
+            {
+                matchers_.push_back( SetMatcher() );
+                matchers_.back().add( agent );
+                xpaths_.push_back( agent.xpath() );
+            } );
+        }
+
+        /**
+         * Scan.  Per-thread evaluation state: a SetMatcher::Scan per column.
+         */
+        class Scan
+        {
+        public:
+            explicit
+            Scan(ColumnProfile& profile)
+            : profile_(profile)
+            , id_(profile.id_)
+            , scans_()
+            {
+                scans_.reserve( profile.matchers_.size() );
+                for ( auto const& matcher : profile.matchers_ )
+                {
+                    scans_.emplace_back( matcher );
+                }
+            }
+
+            // as SetMatcher::Scan, timing each column (writing left out)
+            template<typename Writer>
+            void operator() ( Xml_Node const& root, Writer& writer )
+            {
+                using Clock = std::chrono::steady_clock;
+
+                for ( size_t _c(0); _c < scans_.size(); ++_c )
+                {
+                    Hit                 _hit;
+                    Clock::time_point   _start(Clock::now());
+                    scans_[_c]( root, _hit );
+                    uint64_t const      _ns(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - _start).count());
+                    profile_.record( _c, _ns, _hit.found_, scans_[_c].visited() );
+                    _hit.write( writer );
+                }
+            }
+
+        private:
+            friend class ColumnProfile;
+
+            ColumnProfile&                  profile_;
+            uint64_t const                  id_;
+            std::vector<SetMatcher::Scan>   scans_;
+        };
+
+        // the calling thread's Scan, made on its first call, so that the
+        // scans are built once per thread rather than once per file
+        Scan& local()
+        {
+            thread_local std::unique_ptr<Scan>  _scan;
+            if ( !_scan or _scan->id_ != id_ )
+            {
+                _scan.reset( new Scan(*this) );
+            }
+            return *_scan;
+        }
+
+        // the columns, most costly first
+        void report( std::ostream& os ) const
+        {
+            std::vector<size_t>     _order(counters_.size());
+            uint64_t                _total(0);
+            size_t                  _width(6);
+            for ( size_t _c(0); _c < _order.size(); ++_c )
+            {
+                _order[_c] = _c;
+                _total += counters_[_c].time_;
+                _width = std::max( _width, std::min<size_t>( title( _c ).size(), 24 ) );
+            }
+            std::stable_sort( _order.begin(), _order.end(), [&]( size_t a, size_t b ) -> bool
+            {
+                return counters_[a].time_ > counters_[b].time_;
+            } );
+            char            _line[256];
+            uint64_t const  _evaluations(_order.empty() ? 0 : counters_[0].evaluations_.load());
+            std::snprintf( _line, sizeof _line, "profile: %zu columns, %llu evaluations each, %.3f s in all (columns timed one at a time)\n",
+                _order.size(), static_cast<unsigned long long>(_evaluations), _total / 1e9 );
+            os << _line;
+            std::snprintf( _line, sizeof _line, "profile: rank  %-*s   total ms   share   ns/eval  hits %%  nodes/eval  xpath\n",
+                static_cast<int>(_width), "column" );
+            os << _line;
+            for ( size_t _r(0); _r < _order.size(); ++_r )
+            {
+                size_t const        _c(_order[_r]);
+                Counters const&     _counters(counters_[_c]);
+                uint64_t const      _time(_counters.time_);
+                uint64_t const      _count(_counters.evaluations_);
+                char                _nodes[32];
+                if ( matchers_[_c].walked( 0 ) and _count > 0 )
+                {
+                    std::snprintf( _nodes, sizeof _nodes, "%10.1f", double(_counters.visited_) / _count );
+                }
+                else
+                {
+                    std::snprintf( _nodes, sizeof _nodes, "%10s", "-" ); // by its XpathAgent: not counted
+                }
+                std::snprintf( _line, sizeof _line, "profile: %4zu  %-*.*s %10.3f  %5.1f%%  %8.0f  %6.1f  %s  %s\n",
+                    _r + 1, static_cast<int>(_width), static_cast<int>(_width), title( _c ).c_str(),
+                    _time / 1e6, _total > 0 ? _time * 100.0 / _total : 0.0,
+                    _count > 0 ? double(_time) / _count : 0.0,
+                    _count > 0 ? _counters.hits_ * 100.0 / _count : 0.0,
+                    _nodes, xpaths_[_c].c_str() );
+                os << _line;
+            }
+            os.flush();
+        }
+
+    private:
+        ColumnProfile(ColumnProfile const&) = delete;
+        ColumnProfile& operator= ( ColumnProfile const& ) = delete;
+
+        struct Counters
+        {
+            std::atomic<uint64_t>   time_{ 0 };         // ns
+            std::atomic<uint64_t>   evaluations_{ 0 };
+            std::atomic<uint64_t>   hits_{ 0 };
+            std::atomic<uint64_t>   visited_{ 0 };
+        };
+
+        // AgentSet::headers handler: the titles, the source's first
+        struct Titles
+        {
+            template<typename Iterator>
+            void operator() ( Iterator begin, Iterator const end ) const
+            {
+                titles_.assign( begin, end );
+            }
+
+            std::vector<std::string>&   titles_;
+        };
+
+        // keeps a column's value (a view, valid until its scan's next
+        // evaluation), for the writer once the timing is done
+        struct Hit
+        {
+            Hit()
+            : item_()
+            , found_(false)
+            , empty_(false)
+            {}
+
+            void operator() ( Utility::StringView const& item )
+            {
+                item_ = item;
+                found_ = true;
+            }
+
+            void operator() ()
+            {
+                empty_ = true;
+            }
+
+            template<typename Writer>
+            void write( Writer& writer ) const
+            {
+                if ( found_ )
+                {
+                    writer( item_ );
+                }
+                else
+                if ( empty_ )
+                {
+                    writer();
+                }
+            }
+
+            Utility::StringView     item_;
+            bool                    found_;
+            bool                    empty_;
+        };
+
+        // tells profiles apart from one made later at the same address
+        static uint64_t next_id()
+        {
+            static std::atomic<uint64_t>    _next(0);
+            return ++_next;
+        }
+
+        std::string const& title( size_t column ) const
+        {
+            return titles_[column + 1];
+        }
+
+        void record( size_t column, uint64_t ns, bool hit, size_t visited )
+        {
+            Counters&   _counters(counters_[column]);
+            _counters.time_.fetch_add( ns, std::memory_order_relaxed );
+            _counters.evaluations_.fetch_add( 1, std::memory_order_relaxed );
+            _counters.hits_.fetch_add( hit ? 1 : 0, std::memory_order_relaxed );
+            _counters.visited_.fetch_add( visited, std::memory_order_relaxed );
+        }
+
+        std::vector<std::string>    titles_;
+        std::vector<std::string>    xpaths_;
+        std::vector<SetMatcher>     matchers_;
+        std::vector<Counters>       counters_;
+        uint64_t const              id_;
+    };
+
+} // namespace XmlSys
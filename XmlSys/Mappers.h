@@ -3,7 +3,9 @@
 
 #include "XmlSys/XmlDoc.h"
 #include "XmlSys/AgentSet.h"
+#include "XmlSys/ColumnProfile.h"
 #include "XmlSys/TargetMethods.h"
+#include "Utility/MappedFile.h"
 
 #include <iostream>
 #include <fstream>
@@ -25,6 +27,7 @@ namespace XmlSys
         {
             void on_error( std::string const& msg ) const
             {
+                Utility::Stats::count( Utility::Stats::Failures );
                 std::cerr << msg << std::endl;
             }
         };
@@ -50,7 +53,7 @@ namespace XmlSys
                 Methods::end( target_ );
             }
             
-            void operator() ( std::string const& item ) const
+            void operator() ( Utility::StringView const& item ) const
             {
                 Methods::item( target_, item );
             }
@@ -81,7 +84,7 @@ namespace XmlSys
             Inserter& operator++ (int) { return *this; }
             
             template<typename T>
-            Inserter& operator= ( T& item )
+            Inserter& operator= ( T const& item )
             {
                 writer_( item );
                 return *this; 
@@ -91,12 +94,18 @@ namespace XmlSys
             Writer&    writer_;
         };
 
+        /**
+         * SimpleLoader.  Parses an input into an XmlDoc and hands it to the 
+         * handler.  With reuse, the calling thread's DocSlot is reparsed
+         * instead of a new document being built for every input.
+         */
         template<typename ErrorPolicy = LoadError>
         class SimpleLoader
         {
         public:
-            SimpleLoader(std::string const& label)
+            SimpleLoader(std::string const& label, bool reuse = false)
             : label_(label)
+            , reuse_(reuse)
             {}
             
             template<typename Handler>
@@ -104,7 +113,37 @@ namespace XmlSys
             {
                 try
                 {
-                    handler( XmlDoc(input), label_ );
+                    if ( reuse_ )
+                    {
+                        handler( DocSlot::local().load( input ), label_ );
+                    }
+                    else
+                    {
+                        handler( XmlDoc(input), label_ );
+                    }
+                    return true;
+                }
+                catch ( DocBase::Throw& ex )
+                {
+                    ErrorPolicy().on_error( label_ + ": " + ex.what() );
+                    return false;
+                }
+            }
+            
+            // in-place parse of a mapped (or read) file image
+            template<typename Handler>
+            bool operator() ( Utility::MappedFile& input, Handler const& handler ) const
+            {
+                try
+                {
+                    if ( reuse_ )
+                    {
+                        handler( DocSlot::local().load( input.data(), input.size() ), label_ );
+                    }
+                    else
+                    {
+                        handler( XmlDoc(input.data(), input.size()), label_ );
+                    }
                     return true;
                 }
                 catch ( DocBase::Throw& ex )
@@ -116,6 +155,7 @@ namespace XmlSys
         
         private:
             std::string const   label_;
+            bool const          reuse_;
         };
     }
     
@@ -126,29 +166,49 @@ namespace XmlSys
         AgentMapper(XpathAgent const& agent, Target& target)
         : agent_(agent)
         , target_(target)
+        , reuse_(false)
+        , first_(false)
         {}
 
         using Loader = SimpleLoader<ErrorPolicy>;
+        
+        // reparse a per-thread document rather than building one per input
+        AgentMapper& reuse( bool value ) { reuse_ = value; return *this; }
+        
+        // the first match of each document only
+        AgentMapper& first( bool value ) { first_ = value; return *this; }
 
         bool operator() ( std::istream& input, std::string const& label )
         {
-            return Loader(label)( input, *this );
+            return Loader(label, reuse_)( input, *this );
+        }
+        
+        bool operator() ( Utility::MappedFile& input, std::string const& label )
+        {
+            return Loader(label, reuse_)( input, *this );
         }
         
         void operator() ( XmlDoc const& doc, std::string const& label )  const
         {
             using Inserter = Inserter<Writer<Target> >;
 
-            Writer<Target>      _writer(target_, label);
-            if ( doc.into_list( agent_, Inserter(_writer) ) == 0 )
+            Utility::Stats::Scope   _scope(Utility::Stats::Evaluate);
+            Writer<Target>          _writer(target_, label);
+            size_t const            _matches(first_
+                ? size_t(doc.first_value( agent_, _writer ))
+                : doc.into_list( agent_, Inserter(_writer) ));
+            if ( _matches == 0 )
             {
                 _writer(); // no data
             }
+            Utility::Stats::count( Utility::Stats::Rows, _matches );
         }
         
     private:
         XpathAgent const    agent_;
         Target&             target_;
+        bool                reuse_;
+        bool                first_;
     };
     
     template<typename Target, typename ErrorPolicy = LoadError>
@@ -157,29 +217,41 @@ namespace XmlSys
     public:
         AgentSetMapper(AgentSet const& agents, Target& target)
         : mapper_(agents, target)
+        , reuse_(false)
         {}
         
+        // reparse a per-thread document rather than building one per input
+        AgentSetMapper& reuse( bool value ) { reuse_ = value; return *this; }
+        
+        // evaluate the columns one at a time, into the profile (if any)
+        AgentSetMapper& profile( ColumnProfile* value ) { mapper_.profile( value ); return *this; }
+        
+        // write to another target from now on, the evaluation state kept
+        AgentSetMapper& target( Target& value ) { mapper_.target_ = &value; return *this; }
+        
         AgentSetMapper const& header() const
         {
             mapper_.header();
             return *this;
         }
         
-        void operator() ( XmlDoc const& doc, std::string const& label, std::string const& context ) const
+        void operator() ( XmlDoc const& doc, std::string const& label, XpathAgent const& context ) const
         {
+            Utility::Stats::Scope   _scope(Utility::Stats::Evaluate);
             doc.apply( context, [&]( Xml_Node const& root ) -> void { mapper_( root, label ); } );
         }
         
         void operator() ( XmlDoc const& doc, std::string const& label ) const
         {
+            Utility::Stats::Scope   _scope(Utility::Stats::Evaluate);
             doc.process_root( [&]( Xml_Node const& root ) -> void { mapper_( root, label ); } );
         }
         
         using Loader = SimpleLoader<ErrorPolicy>;
 
-        bool operator() ( std::istream& input, std::string const& label, std::string const& context ) const
+        bool operator() ( std::istream& input, std::string const& label, XpathAgent const& context ) const
         {
-            return Loader(label)( input, [&]( XmlDoc const& doc, std::string const& label ) -> void
+            return Loader(label, reuse_)( input, [&]( XmlDoc const& doc, std::string const& label ) -> void
             {
                 (*this)( doc, label, context );
             } );
@@ -187,7 +259,20 @@ namespace XmlSys
         
         bool operator() ( std::istream& input, std::string const& label ) const
         {
-            return Loader(label)( input, *this );
+            return Loader(label, reuse_)( input, *this );
+        }
+        
+        bool operator() ( Utility::MappedFile& input, std::string const& label, XpathAgent const& context ) const
+        {
+            return Loader(label, reuse_)( input, [&]( XmlDoc const& doc, std::string const& label ) -> void
+            {
+                (*this)( doc, label, context );
+            } );
+        }
+        
+        bool operator() ( Utility::MappedFile& input, std::string const& label ) const
+        {
+            return Loader(label, reuse_)( input, *this );
         }
         
    private:
@@ -195,16 +280,24 @@ namespace XmlSys
         {
             Mapper(AgentSet const& agents, Target& target)
             : agents_(agents)
-            , target_(target)
+            , target_(&target)
+            , scan_(agents.matcher())
+            , profiled_(nullptr)
             {}
             
+            // the calling thread's, which must be the evaluating thread
+            void profile( ColumnProfile* profile )
+            {
+                profiled_ = profile ? &profile->local() : nullptr;
+            }
+            
             // used to generate header row
             template<typename Iterator>
             void operator() ( Iterator begin, Iterator const end ) const
             {
                 if ( begin != end )
                 {
-                    Writer<Target>      _writer(target_, *begin);
+                    Writer<Target>      _writer(*target_, *begin);
                     while ( ++begin != end )
                     {
                         _writer( *begin );
@@ -219,20 +312,25 @@ namespace XmlSys
             
             void operator() ( Xml_Node const& node, std::string const& label ) const
             {
-                Writer<Target>  _writer(target_, label);
-                agents_.apply( [&]( XpathAgent const& agent ) -> void 
+                Writer<Target>  _writer(*target_, label);
+                // one walk of the subtree for all columns, first value each
+                if ( profiled_ )
                 {
-                    // this XpathAgent interface selects at most one value. 
-                    if ( !agent.value( node, _writer ) )
-                    {
-                        _writer(); // no data
-                    }
-                } );
+                    (*profiled_)( node, _writer );
+                }
+                else
+                {
+                    scan_( node, _writer );
+                }
+                Utility::Stats::count( Utility::Stats::Rows );
             }
             
-            AgentSet const&     agents_;
-            Target&             target_;
+            AgentSet const&             agents_;
+            Target*                     target_;
+            mutable SetMatcher::Scan    scan_;
+            ColumnProfile::Scan*        profiled_;
         }               mapper_;
+        bool            reuse_;
     };
 } // namespace XmlSys
     
@@ -0,0 +1,337 @@
+
+#pragma once
+
+#include <pugixml.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ostream>
+#include <vector>
+
+namespace XmlSys
+{
+    /**
+     * PageCache.  pugixml allocation hooks that keep freed blocks on
+     * per-thread free lists instead of returning them to malloc, so that a
+     * thread takes back the blocks it just released without going through
+     * the shared allocator (or mmap, for large ones) at all: DOM pages and
+     * XPath scratch blocks, the two sizes pugixml allocates over and over,
+     * and other blocks over 4 KB up to 4 MB (input buffers, node sets),
+     * rounded up to a power of two, up to budget() bytes of them per
+     * thread.  A block freed on another thread than the one that allocated
+     * it joins that thread's lists, so the pools suit threads that free
+     * what they allocate, not stages that hand documents on (xpmatch does
+     * not install them with --pipeline).  Smaller and larger blocks go
+     * straight to malloc/free.  Each thread counts its allocations; the
+     * counts are added up when it exits.  install() must be called before
+     * any document or XpathAgent is created, and uninstall() only once they
+     * are all gone.
+     */
+    class PageCache
+    {
+    public:
+        // pugixml's xml_memory_page_size (PUGIXML_MEMORY_PAGE_SIZE); a page
+        // request adds a small header and alignment slack to this
+        static const size_t page_data  = 32768;
+        static const size_t page_block = page_data + 256;
+
+        // pugixml's xpath_memory_block (PUGIXML_MEMORY_XPATH_PAGE_SIZE): a
+        // next pointer and a capacity, then the data
+        static const size_t block_data  = 4096;
+        static const size_t xpath_block = block_data + sizeof(void*) + sizeof(size_t);
+
+        // size classes, for blocks over block_data: 2^sized_min (8 KB) to
+        // 2^sized_max (4 MB) bytes
+        static const size_t sized_min = 13;
+        static const size_t sized_max = 22;
+        static const size_t sizes     = sized_max - sized_min + 1;
+
+        enum Class { Page, Block, Sized, Other, Classes };
+
+        struct Counts
+        {
+            uint64_t    allocations_;
+            uint64_t    reused_;    // taken from a free list
+            uint64_t    bytes_;     // as requested
+        };
+
+        static void install()
+        {
+            pugi::set_memory_management_functions( allocate, deallocate );
+            installed() = true;
+        }
+
+        // back to plain malloc/free
+        static void uninstall()
+        {
+            pugi::set_memory_management_functions( std::malloc, std::free );
+            installed() = false;
+        }
+
+        static bool& installed()
+        {
+            static bool     _installed(false);
+            return _installed;
+        }
+
+        // creates the calling thread's cache now, so that it outlives any
+        // thread_local object created after it (whose pages it takes back)
+        static void attach()
+        {
+            if ( installed() )
+            {
+                local();
+            }
+        }
+
+        // pre-size the calling thread's cache for about this many bytes of DOM
+        static void reserve( size_t bytes )
+        {
+            if ( !installed() )
+            {
+                return;
+            }
+            Pages&      _pages(local());
+            size_t      _want(std::min( bytes / page_data + 1, limit() ));
+            while ( _pages.pages_.size() < _want )
+            {
+                void*   _block(raw( page_block ));
+                if ( !_block )
+                {
+                    return;
+                }
+                _pages.pages_.push_back( _block );
+            }
+        }
+
+        // upper bound on pages held per thread
+        static size_t& limit()
+        {
+            static size_t   _limit(1024);
+            return _limit;
+        }
+
+        // upper bound on bytes of size-class blocks held per thread
+        static size_t& budget()
+        {
+            static size_t   _budget(16 << 20);
+            return _budget;
+        }
+
+        // of exited threads and the calling one
+        static Counts counts( Class type )
+        {
+            Totals const&   _totals(totals());
+            Counts const&   _local(local().counts_[type]);
+            return Counts{ _totals.allocations_[type] + _local.allocations_, _totals.reused_[type] + _local.reused_, _totals.bytes_[type] + _local.bytes_ };
+        }
+
+        static void report( std::ostream& os )
+        {
+            Counts const    _page(counts( Page ));
+            Counts const    _block(counts( Block ));
+            Counts const    _sized(counts( Sized ));
+            Counts const    _other(counts( Other ));
+            char            _line[256];
+            std::snprintf( _line, sizeof _line, "stats: alloc DOM pages %llu (%.1f%% reused), XPath blocks %llu (%.1f%% reused), "
+                "4K-4M blocks %llu (%.1f%% reused, %.1f MB), other %llu (%.1f MB)\n",
+                static_cast<unsigned long long>(_page.allocations_), share( _page ),
+                static_cast<unsigned long long>(_block.allocations_), share( _block ),
+                static_cast<unsigned long long>(_sized.allocations_), share( _sized ), _sized.bytes_ / 1e6,
+                static_cast<unsigned long long>(_other.allocations_), _other.bytes_ / 1e6 );
+            os << _line << std::flush;
+        }
+
+    private:
+        // keeps malloc alignment for the caller
+        union Header
+        {
+            size_t          size_;
+            std::max_align_t align_;
+        };
+
+        struct Totals
+        {
+            std::atomic<uint64_t>   allocations_[Classes];
+            std::atomic<uint64_t>   reused_[Classes];
+            std::atomic<uint64_t>   bytes_[Classes];
+        };
+
+        struct Pages
+        {
+            std::vector<void*>  pages_;
+            std::vector<void*>  blocks_;
+            std::vector<void*>  sized_[sizes];
+            size_t              held_;      // bytes in sized_
+            Counts              counts_[Classes];
+
+            Pages()
+            : pages_()
+            , blocks_()
+            , held_(0)
+            {
+                for ( int _c(0); _c < Classes; ++_c )
+                {
+                    counts_[_c] = Counts{ 0, 0, 0 };
+                }
+            }
+
+            ~Pages()
+            {
+                for ( void* block : pages_ )
+                {
+                    std::free( block );
+                }
+                for ( void* block : blocks_ )
+                {
+                    std::free( block );
+                }
+                for ( auto const& free : sized_ )
+                {
+                    for ( void* block : free )
+                    {
+                        std::free( block );
+                    }
+                }
+                Totals&     _totals(totals());
+                for ( int _c(0); _c < Classes; ++_c )
+                {
+                    _totals.allocations_[_c].fetch_add( counts_[_c].allocations_, std::memory_order_relaxed );
+                    _totals.reused_[_c].fetch_add( counts_[_c].reused_, std::memory_order_relaxed );
+                    _totals.bytes_[_c].fetch_add( counts_[_c].bytes_, std::memory_order_relaxed );
+                }
+            }
+
+            // a block of the free list, or a new one of that size
+            void* take( Class type, std::vector<void*>& free, size_t block, size_t size )
+            {
+                Counts&     _counts(counts_[type]);
+                void*       _block(nullptr);
+                if ( free.empty() )
+                {
+                    _block = raw( block );
+                }
+                else
+                {
+                    _block = free.back();
+                    free.pop_back();
+                    ++_counts.reused_;
+                    if ( type == Sized )
+                    {
+                        held_ -= block;
+                    }
+                }
+                ++_counts.allocations_;
+                _counts.bytes_ += size;
+                return _block ? static_cast<Header*>(_block) + 1 : nullptr;
+            }
+        };
+
+        static Totals& totals()
+        {
+            static Totals   _totals{};
+            return _totals;
+        }
+
+        static Pages& local()
+        {
+            thread_local Pages  _pages;
+            return _pages;
+        }
+
+        static double share( Counts const& counts )
+        {
+            return counts.allocations_ > 0 ? counts.reused_ * 100.0 / counts.allocations_ : 0.0;
+        }
+
+        static bool is_page( size_t size )
+        {
+            return size >= page_data and size <= page_block;
+        }
+
+        // the size class of a block of this size, or sizes if none
+        static size_t size_class( size_t size )
+        {
+            if ( size > (size_t(1) << sized_max) )
+            {
+                return sizes;
+            }
+            size_t      _class(0);
+            while ( (size_t(1) << (sized_min + _class)) < size )
+            {
+                ++_class;
+            }
+            return _class;
+        }
+
+        static void* raw( size_t size )
+        {
+            Header*     _header(static_cast<Header*>(std::malloc( sizeof(Header) + size )));
+            if ( !_header )
+            {
+                return nullptr;
+            }
+            _header->size_ = size;
+            return _header;
+        }
+
+        static void* allocate( size_t size )
+        {
+            Pages&      _pages(local());
+            if ( is_page( size ) )
+            {
+                return _pages.take( Page, _pages.pages_, page_block, size );
+            }
+            if ( size == xpath_block )
+            {
+                return _pages.take( Block, _pages.blocks_, xpath_block, size );
+            }
+            size_t const    _class(size > block_data ? size_class( size ) : sizes);
+            if ( _class < sizes )
+            {
+                return _pages.take( Sized, _pages.sized_[_class], size_t(1) << (sized_min + _class), size );
+            }
+            Counts&     _counts(_pages.counts_[Other]);
+            ++_counts.allocations_;
+            _counts.bytes_ += size;
+            Header*     _header(static_cast<Header*>(raw( size )));
+            return _header ? _header + 1 : nullptr;
+        }
+
+        static void deallocate( void* ptr )
+        {
+            if ( !ptr )
+            {
+                return;
+            }
+            Header*         _header(static_cast<Header*>(ptr) - 1);
+            size_t const    _size(_header->size_);
+            if ( _size == page_block or _size == xpath_block )
+            {
+                Pages&              _pages(local());
+                std::vector<void*>& _free(_size == page_block ? _pages.pages_ : _pages.blocks_);
+                if ( _free.size() < limit() )
+                {
+                    _free.push_back( _header );
+                    return;
+                }
+            }
+            else
+            if ( _size > block_data and (_size & (_size - 1)) == 0 and _size <= (size_t(1) << sized_max) )
+            {
+                Pages&      _pages(local());
+                if ( _pages.held_ + _size <= budget() )
+                {
+                    _pages.sized_[size_class( _size )].push_back( _header );
+                    _pages.held_ += _size;
+                    return;
+                }
+            }
+            std::free( _header );
+        }
+    };
+
+} // namespace XmlSys
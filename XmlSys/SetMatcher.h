@@ -0,0 +1,457 @@
+
+#pragma once
+
+#include "XmlSys/StreamPath.h"
+#include "XmlSys/XpathAgent.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace XmlSys
+{
+    /**
+     * SetMatcher.  The columns of an AgentSet compiled for evaluation in
+     * one traversal of each context subtree, which skips subtrees where
+     * nothing can match and stops once every column has its first match.
+     * Paths of child and self steps only share a prefix trie, so one
+     * lookup per element serves all of them; paths with '//' steps each
+     * run a PathRun.  Other columns (absolute paths, functions, other
+     * axes, etc.) fall back to their XpathAgent.
+     * Results are those of XpathAgent::value for each column.
+     */
+    class SetMatcher
+    {
+    public:
+        SetMatcher()
+        : columns_()
+        , trie_(1)
+        , runners_()
+        {}
+
+        void add( XpathAgent const& agent )
+        {
+            columns_.push_back( Column{ agent, compile( agent ), false } );
+            Column&     _column(columns_.back());
+            if ( !_column.path_ )
+            {
+                return;
+            }
+            if ( linear( *_column.path_ ) )
+            {
+                _column.trie_ = true;
+                insert( columns_.size() - 1 );
+            }
+            else
+            {
+                runners_.push_back( columns_.size() - 1 );
+            }
+        }
+
+        size_t size() const { return columns_.size(); }
+
+        // see XpathAgent::deferred(): the walk decodes what it compares
+        bool deferrable() const
+        {
+            for ( auto const& column : columns_ )
+            {
+                if ( !column.path_ and !column.agent_.deferrable() )
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // evaluated by the walk, rather than by its XpathAgent
+        bool walked( size_t column ) const { return bool(columns_[column].path_); }
+
+    private:
+        typedef StreamPath::Step    Step;
+
+        struct Column
+        {
+            XpathAgent                          agent_;
+            std::shared_ptr<StreamPath const>   path_;  // null: not walkable
+            bool                                trie_;  // else a PathRun
+        };
+
+        // an element step and the self steps after it (from the trie root,
+        // self steps only); a node's edges are sorted by the first step's
+        // name test, wildcards first
+        struct Edge
+        {
+            Edge(std::vector<Step const*> const& steps, size_t target)
+            : steps_(steps)
+            , test_(steps.empty() ? "" : steps.front()->test_)
+            , wildcard_(test_.empty() or test_ == "*")
+            , target_(target)
+            {}
+
+            bool matches( Xml_Node const& node ) const
+            {
+                for ( Step const* step : steps_ )
+                {
+                    if ( !StreamPath::matches( *step, node ) )
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            std::vector<Step const*>    steps_;
+            std::string                 test_;
+            bool                        wildcard_;
+            size_t                      target_;
+        };
+
+        struct Node
+        {
+            std::vector<Edge>       edges_;
+            std::vector<size_t>     ends_;      // columns whose path ends here
+        };
+
+    public:
+        /**
+         * Scan.  Per-thread evaluation state, reused from one context
+         * node to the next.
+         */
+        class Scan
+        {
+        public:
+            explicit
+            Scan(SetMatcher const& matcher)
+            : matcher_(matcher)
+            , runs_(matcher.columns_.size())
+            , cells_(matcher.columns_.size())
+            , nodes_()
+            , marks_()
+            , pending_(0)
+            , visited_(0)
+            {}
+
+            // elements the last walk looked at (the context node included)
+            size_t visited() const { return visited_; }
+
+            // passes the first value of each column, in order, to the writer
+            // (or calls it with no arguments for a column without a match)
+            template<typename Writer>
+            void operator() ( Xml_Node const& root, Writer& writer )
+            {
+                auto const&     _columns(matcher_.columns_);
+                pending_ = 0;
+                for ( size_t _c(0); _c < _columns.size(); ++_c )
+                {
+                    Cell&   _cell(cells_[_c]);
+                    _cell.found_ = false;
+                    _cell.live_ = bool(_columns[_c].path_);
+                    if ( !_cell.live_ )
+                    {
+                        continue;
+                    }
+                    ++pending_;
+                    if ( !_columns[_c].trie_ and runs_[_c].start( *_columns[_c].path_, root ) )
+                    {
+                        resolve( _c, root );
+                    }
+                }
+                nodes_.clear();
+                marks_.assign( 1, 0 );
+                visited_ = 1;
+                step( 0, root );
+                if ( pending_ > 0 and live() )
+                {
+                    descend( root );
+                }
+                for ( size_t _c(0); _c < _columns.size(); ++_c )
+                {
+                    if ( !_columns[_c].path_ )
+                    {
+                        if ( !_columns[_c].agent_.value( root, writer ) )
+                        {
+                            writer(); // no data
+                        }
+                    }
+                    else
+                    if ( cells_[_c].found_ )
+                    {
+                        writer( cells_[_c].value_ );
+                    }
+                    else
+                    {
+                        writer(); // no data
+                    }
+                }
+            }
+
+        private:
+            struct Cell
+            {
+                bool                    found_;
+                bool                    live_;      // walked column, still unresolved
+                Utility::StringView     value_;     // into the document, or decoded_
+                std::string             decoded_;
+            };
+
+            void resolve( size_t column, Xml_Node const& node )
+            {
+                Cell&               _cell(cells_[column]);
+                std::string const&  _attribute(matcher_.columns_[column].path_->attribute());
+                _cell.found_ = true;
+                _cell.live_ = false;
+                _cell.value_ = _attribute.empty()
+                    ? XpathAgent::valueOf( node, _cell.decoded_ )
+                    : XpathAgent::valueOf( node.attribute( _attribute.c_str() ), _cell.decoded_ )
+                    ;
+                --pending_;
+            }
+
+            // follows the edges of trie node 'from' that the element matches
+            void step( size_t from, Xml_Node const& node )
+            {
+                auto const&     _edges(matcher_.trie_[from].edges_);
+                auto            _edge(_edges.begin());
+                for ( ; _edge != _edges.end() and _edge->wildcard_; ++_edge )
+                {
+                    follow( *_edge, node );
+                }
+                if ( _edge == _edges.end() )
+                {
+                    return;
+                }
+                char const*     _name(node.name());
+                _edge = std::lower_bound( _edge, _edges.end(), _name, []( Edge const& edge, char const* name ) -> bool
+                {
+                    return std::strcmp( edge.test_.c_str(), name ) < 0;
+                } );
+                for ( ; _edge != _edges.end() and _edge->test_ == _name; ++_edge )
+                {
+                    follow( *_edge, node );
+                }
+            }
+
+            void follow( Edge const& edge, Xml_Node const& node )
+            {
+                if ( !edge.matches( node ) )
+                {
+                    return;
+                }
+                Node const&     _target(matcher_.trie_[edge.target_]);
+                for ( size_t column : _target.ends_ )
+                {
+                    std::string const&  _attribute(matcher_.columns_[column].path_->attribute());
+                    if ( cells_[column].live_ and (_attribute.empty() or StreamPath::has_attribute( node, _attribute )) )
+                    {
+                        resolve( column, node );
+                    }
+                }
+                if ( !_target.edges_.empty() )
+                {
+                    nodes_.push_back( edge.target_ );
+                }
+            }
+
+            // can an unresolved column still match below the current element?
+            bool live() const
+            {
+                if ( nodes_.size() > marks_.back() )
+                {
+                    return true;
+                }
+                for ( size_t column : matcher_.runners_ )
+                {
+                    if ( cells_[column].live_ and !runs_[column].dead() )
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            // preorder walk of the element children; false once all resolved
+            bool descend( Xml_Node const& parent )
+            {
+                auto const&     _runners(matcher_.runners_);
+                for ( Xml_Node _child(parent.first_child()); _child; _child = _child.next_sibling() )
+                {
+                    if ( _child.type() != pugi::node_element )
+                    {
+                        continue;
+                    }
+                    ++visited_;
+                    size_t const    _begin(marks_.back());
+                    size_t const    _end(nodes_.size());
+                    marks_.push_back( _end );
+                    for ( size_t _i(_begin); _i < _end; ++_i )
+                    {
+                        step( nodes_[_i], _child );
+                    }
+                    for ( size_t column : _runners )
+                    {
+                        if ( cells_[column].live_ and runs_[column].enter( _child ) )
+                        {
+                            resolve( column, _child );
+                        }
+                    }
+                    if ( pending_ == 0 )
+                    {
+                        return false;
+                    }
+                    bool    _more(!live() or descend( _child ));
+                    for ( size_t column : _runners )
+                    {
+                        if ( cells_[column].live_ )
+                        {
+                            runs_[column].leave();
+                        }
+                    }
+                    nodes_.resize( marks_.back() );
+                    marks_.pop_back();
+                    if ( !_more )
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            SetMatcher const&       matcher_;
+            std::vector<PathRun>    runs_;
+            std::vector<Cell>       cells_;
+            std::vector<size_t>     nodes_;     // active trie nodes, per open element
+            std::vector<size_t>     marks_;
+            size_t                  pending_;
+            size_t                  visited_;
+        };
+
+    private:
+        // paths a walk below the context node can evaluate exactly
+        static bool walkable( StreamPath const& path, XpathAgent const& agent )
+        {
+            if ( path.absolute() or path.attribute().empty() == agent.fromAtt() )
+            {
+                return false;
+            }
+            // a final node() step may select text
+            auto const&     _steps(path.steps());
+            return _steps.empty()
+                or _steps.back().axis_ != StreamPath::Child
+                or !_steps.back().test_.empty()
+                ;
+        }
+
+        static bool linear( StreamPath const& path )
+        {
+            for ( auto const& step : path.steps() )
+            {
+                if ( step.axis_ == StreamPath::DescendantOrSelf )
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static std::shared_ptr<StreamPath const> compile( XpathAgent const& agent )
+        {
+            try
+            {
+                std::shared_ptr<StreamPath const>   _path(new StreamPath(StreamPath::compile( agent.xpath() )));
+                if ( walkable( *_path, agent ) )
+                {
+                    return _path;
+                }
+            }
+            catch ( XpathAgent::BadXpath const& )
+            {
+                // not in the subset: evaluated by the agent itself
+            }
+            return nullptr;
+        }
+
+        static bool same( Step const& a, Step const& b )
+        {
+            if ( a.axis_ != b.axis_ or a.test_ != b.test_ or a.predicates_.size() != b.predicates_.size() )
+            {
+                return false;
+            }
+            for ( size_t _p(0); _p < a.predicates_.size(); ++_p )
+            {
+                auto const&     _a(a.predicates_[_p]);
+                auto const&     _b(b.predicates_[_p]);
+                if ( _a.attribute_ != _b.attribute_ or _a.compare_ != _b.compare_ or _a.value_ != _b.value_ )
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static bool same( std::vector<Step const*> const& a, std::vector<Step const*> const& b )
+        {
+            if ( a.size() != b.size() )
+            {
+                return false;
+            }
+            for ( size_t _s(0); _s < a.size(); ++_s )
+            {
+                if ( !same( *a[_s], *b[_s] ) )
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // adds a linear path to the trie: leading self steps (matched by
+        // the context node), then one edge per child step
+        void insert( size_t column )
+        {
+            auto const&                 _steps(columns_[column].path_->steps());
+            std::vector<Step const*>    _segment;
+            size_t                      _s(0);
+            while ( _s < _steps.size() and _steps[_s].axis_ == StreamPath::Self )
+            {
+                _segment.push_back( &_steps[_s++] );
+            }
+            size_t                      _node(edge( 0, _segment ));
+            while ( _s < _steps.size() )
+            {
+                _segment.assign( 1, &_steps[_s++] );
+                while ( _s < _steps.size() and _steps[_s].axis_ == StreamPath::Self )
+                {
+                    _segment.push_back( &_steps[_s++] );
+                }
+                _node = edge( _node, _segment );
+            }
+            trie_[_node].ends_.push_back( column );
+        }
+
+        // the target of the node's edge for this segment, added if need be
+        size_t edge( size_t node, std::vector<Step const*> const& segment )
+        {
+            for ( auto const& edge : trie_[node].edges_ )
+            {
+                if ( same( edge.steps_, segment ) )
+                {
+                    return edge.target_;
+                }
+            }
+            Edge        _edge(segment, trie_.size());
+            trie_.push_back( Node() );
+            auto&       _edges(trie_[node].edges_);
+            _edges.insert( std::upper_bound( _edges.begin(), _edges.end(), _edge, []( Edge const& a, Edge const& b ) -> bool
+            {
+                return a.wildcard_ != b.wildcard_ ? a.wildcard_ : a.test_ < b.test_;
+            } ), _edge );
+            return _edge.target_;
+        }
+
+        std::vector<Column>     columns_;
+        std::vector<Node>       trie_;      // trie_[0]: the context node's parent, in effect
+        std::vector<size_t>     runners_;   // columns matched by a PathRun
+    };
+
+} // namespace XmlSys
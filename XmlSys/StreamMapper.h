@@ -0,0 +1,508 @@
+
+#pragma once
+
+#include "XmlSys/Mappers.h"
+#include "XmlSys/StreamPath.h"
+#include "XmlSys/XmlStream.h"
+
+#include <deque>
+
+    /**
+     * StreamMapper.h.
+     * DOM-free counterpart of AgentSetMapper: the input is scanned once,
+     * with bounded memory, and a row is written as soon as its initial
+     * context element (and every context that started before it) closes.
+     * Output is the same as AgentSetMapper's for well-formed input; rows
+     * completed before a parse error have already been written.  With
+     * early(), a document of one row at most is read only until every
+     * column of that row has its value.
+     */
+
+namespace XmlSys
+{
+    /**
+     * StreamPlan.  An AgentSet and initial context compiled to StreamPaths.
+     * Column paths must be relative; a relative (or missing) context is
+     * taken from the document element, as AgentSetMapper does.  Or, for
+     * grep mode, a single path (taken from the document node if absolute,
+     * else from the document element, as AgentMapper does), the first
+     * match only; its row is then the document's.  The AgentSet (or the
+     * XpathAgent) is kept by reference, for documents that are not UTF-8
+     * and so go to the DOM mappers, and must outlive the plan.
+     */
+    class StreamPlan
+    {
+    public:
+        explicit
+        StreamPlan(AgentSet const& agents, std::string const& initial = "")
+        : context_(StreamPath::compile( initial.empty() ? "." : initial ))
+        , columns_()
+        , document_(false)
+        , early_(false)
+        , agents_(&agents)
+        , agent_(nullptr)
+        , initial_(initial)
+        {
+            if ( !context_.attribute().empty() )
+            {
+                throw XpathAgent::BadXpath(initial, "initial context must select elements");
+            }
+            agents.apply( [&]( XpathAgent const& agent ) -> void
+            {
+                columns_.push_back( StreamPath::compile( agent.xpath() ) );
+                if ( columns_.back().absolute() )
+                {
+                    throw XpathAgent::BadXpath(agent.xpath(), "absolute column path (not supported in streaming mode)");
+                }
+            } );
+        }
+
+        explicit
+        StreamPlan(XpathAgent const& agent)
+        : context_(StreamPath::compile( "." ))
+        , columns_(1, StreamPath::compile( agent.xpath() ))
+        , document_(columns_.front().absolute())
+        , early_(false)
+        , agents_(nullptr)
+        , agent_(&agent)
+        , initial_()
+        {
+            if ( columns_.front().attribute().empty() == agent.fromAtt() )
+            {
+                throw XpathAgent::BadXpath(agent.xpath(), "attribute and element values mixed");
+            }
+        }
+
+        StreamPath const& context() const { return context_; }
+        std::vector<StreamPath> const& columns() const { return columns_; }
+
+        // the one row is the document's (grep mode, an absolute path)
+        bool document() const { return document_; }
+
+        // can there be one row per document at most?  Only if the context
+        // is the document, or can match the document element alone
+        bool single() const
+        {
+            if ( document_ )
+            {
+                return true;
+            }
+            auto const&     _steps(context_.steps());
+            if ( context_.absolute() )
+            {
+                return _steps.size() == 1 and _steps[0].axis_ == StreamPath::Child;
+            }
+            for ( auto const& step : _steps )
+            {
+                if ( step.axis_ != StreamPath::Self )
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // stop reading a document once its row is complete (if single())
+        StreamPlan& early( bool value ) { early_ = value and single(); return *this; }
+        bool early() const { return early_; }
+
+        // what the plan was compiled from: the AgentSet and initial context,
+        // or (grep mode) the XpathAgent, the other being null
+        AgentSet const* agents() const { return agents_; }
+        XpathAgent const* agent() const { return agent_; }
+        std::string const& initial() const { return initial_; }
+
+    private:
+        StreamPath                  context_;
+        std::vector<StreamPath>     columns_;
+        bool                        document_;
+        bool                        early_;
+        AgentSet const*             agents_;
+        XpathAgent const*           agent_;
+        std::string                 initial_;
+    };
+
+    template<typename Target, typename ErrorPolicy = LoadError>
+    class StreamSetMapper
+    {
+    public:
+        StreamSetMapper(StreamPlan const& plan, Target& target)
+        : plan_(plan)
+        , target_(target)
+        {}
+
+        bool operator() ( std::istream& input, std::string const& label ) const
+        {
+            XmlStream   _stream(input);
+            if ( !_stream.utf8() )
+            {
+                std::vector<char>       _heap(_stream.rest());
+                size_t const            _size(_heap.size());
+                Utility::MappedFile     _image(std::move( _heap ), _size);
+                if ( !_image )
+                {
+                    ErrorPolicy().on_error( label + ": Problem with reading the input!" );
+                    return false;
+                }
+                return dom( _image, label );
+            }
+            return run( _stream, label, plan_.early() ? size_of( input ) : 0 );
+        }
+
+        bool operator() ( Utility::MappedFile& input, std::string const& label ) const
+        {
+            XmlStream   _stream(input.data(), input.size());
+            if ( !_stream.utf8() )
+            {
+                return dom( input, label );
+            }
+            return run( _stream, label, input.size() );
+        }
+
+    private:
+        typedef StreamPath::Attributes  Attributes;
+
+        // a document the scanner cannot read (not UTF-8) goes to the DOM
+        // mapper the plan stands for, which pugixml converts from UTF-16 or
+        // UTF-32; its output is the same, if not its speed
+        bool dom( Utility::MappedFile& input, std::string const& label ) const
+        {
+            if ( plan_.agent() )
+            {
+                return AgentMapper<Target, ErrorPolicy>(*plan_.agent(), target_).first( true )( input, label );
+            }
+            AgentSetMapper<Target, ErrorPolicy>     _mapper(*plan_.agents(), target_);
+            if ( plan_.initial().empty() )
+            {
+                return _mapper( input, label );
+            }
+            return _mapper( input, label, XpathAgent(plan_.initial()) );
+        }
+
+        // size: of the document, if known (else 0), for the bytes skipped
+        bool run( XmlStream& stream, std::string const& label, size_t size ) const
+        {
+            // a single pass: all of it counts as parsing (reading included)
+            Utility::Stats::Scope   _scope(Utility::Stats::Parse);
+            Scan                    _scan(plan_, target_, label);
+            if ( !stream.parse( _scan ) )
+            {
+                ErrorPolicy().on_error( label + ": " + stream.err_msg() );
+                return false;
+            }
+            if ( _scan.finished() )
+            {
+                Utility::Stats::count( Utility::Stats::Stopped );
+                Utility::Stats::count( Utility::Stats::Skipped, size > stream.offset() ? size - stream.offset() : 0 );
+            }
+            else
+            {
+                _scan.finish();
+            }
+            Utility::Stats::count( Utility::Stats::Documents );
+            Utility::Stats::count( Utility::Stats::Bytes, stream.offset() );
+            return true;
+        }
+
+        // bytes from the current position to the end, if the stream seeks
+        static size_t size_of( std::istream& input )
+        {
+            std::streambuf*         _buffer(input.rdbuf());
+            std::streampos const    _here(_buffer->pubseekoff( 0, std::ios::cur, std::ios::in ));
+            std::streampos const    _end(_buffer->pubseekoff( 0, std::ios::end, std::ios::in ));
+            if ( _here == std::streampos(-1) or _end == std::streampos(-1) or _buffer->pubseekpos( _here, std::ios::in ) != _here )
+            {
+                return 0;
+            }
+            return _end - _here;
+        }
+
+        struct Cell
+        {
+            bool            found_;
+            bool            complete_;
+            size_t          level_;     // of the matched element, while its text is awaited
+            std::string     value_;
+        };
+
+        struct Probe
+        {
+            bool            live_;      // column not yet resolved
+            PathRun         run_;
+        };
+
+        // one initial context instance; recycled, so vectors keep capacity
+        struct Row
+        {
+            size_t              level_;
+            bool                done_;
+            size_t              pending_;   // cells not yet complete
+            std::vector<Cell>   cells_;
+            std::vector<Probe>  probes_;
+        };
+
+        /**
+         * Scan.  XmlStream handler for one document.
+         */
+        class Scan
+        {
+        public:
+            Scan(StreamPlan const& plan, Target& target, std::string const& label)
+            : plan_(plan)
+            , target_(target)
+            , label_(label)
+            , level_(0)
+            , roots_(0)
+            , context_()
+            , active_(plan.context().absolute())
+            , rows_()
+            , spare_()
+            , waiting_(1, 0)
+            , stopped_(false)
+            {
+                if ( plan_.document() )
+                {
+                    open( StreamPath::Tag{ nullptr, nullptr } );
+                }
+                else
+                if ( active_ )
+                {
+                    context_.start( plan_.context(), StreamPath::Tag{ nullptr, nullptr } );
+                }
+            }
+
+            // with an early() plan, once the one row is complete it is
+            // written, and the rest of the document is not read
+            bool finished()
+            {
+                if ( plan_.early() and !stopped_ and !rows_.empty() and rows_.front().pending_ == 0 )
+                {
+                    rows_.front().done_ = true;
+                    flush();
+                    stopped_ = true;
+                }
+                return stopped_;
+            }
+
+            // at the end of the document: the document's row, if any
+            void finish()
+            {
+                for ( auto& row : rows_ )
+                {
+                    row.done_ = true;
+                    for ( auto& cell : row.cells_ )
+                    {
+                        cell.complete_ = true; // no text: empty value
+                    }
+                }
+                flush();
+            }
+
+            void start( std::string const& name, Attributes const& atts )
+            {
+                StreamPath::Tag const   _tag{ &name, &atts };
+                ++level_;
+                if ( waiting_.size() <= level_ )
+                {
+                    waiting_.resize( level_ + 1, 0 );
+                }
+                for ( auto& row : rows_ )
+                {
+                    if ( row.done_ )
+                    {
+                        continue;
+                    }
+                    for ( size_t _c(0); _c < row.probes_.size(); ++_c )
+                    {
+                        Probe&  _probe(row.probes_[_c]);
+                        if ( _probe.live_ and _probe.run_.enter( _tag ) )
+                        {
+                            _probe.live_ = false;
+                            resolve( row, _c, _tag );
+                        }
+                    }
+                }
+                if ( !plan_.document() and context( _tag ) )
+                {
+                    open( _tag );
+                }
+            }
+
+            void end()
+            {
+                if ( waiting_[level_] > 0 )
+                {
+                    for ( auto& row : rows_ )
+                    {
+                        for ( auto& cell : row.cells_ )
+                        {
+                            if ( cell.found_ and !cell.complete_ and cell.level_ == level_ )
+                            {
+                                complete( row, cell ); // no text: empty value
+                            }
+                        }
+                    }
+                    waiting_[level_] = 0;
+                }
+                for ( auto& row : rows_ )
+                {
+                    if ( row.done_ )
+                    {
+                        continue;
+                    }
+                    if ( row.level_ == level_ )
+                    {
+                        row.done_ = true;
+                    }
+                    else
+                    {
+                        for ( auto& probe : row.probes_ )
+                        {
+                            if ( probe.live_ )
+                            {
+                                probe.run_.leave();
+                            }
+                        }
+                    }
+                }
+                if ( active_ and (plan_.context().absolute() or level_ > 1) )
+                {
+                    context_.leave();
+                }
+                flush();
+                --level_;
+            }
+
+            bool capturing() const
+            {
+                return waiting_[level_] > 0;
+            }
+
+            void text( std::string const& value )
+            {
+                for ( auto& row : rows_ )
+                {
+                    for ( auto& cell : row.cells_ )
+                    {
+                        if ( cell.found_ and !cell.complete_ and cell.level_ == level_ )
+                        {
+                            cell.value_ = value;
+                            complete( row, cell );
+                        }
+                    }
+                }
+                waiting_[level_] = 0;
+            }
+
+        private:
+            // does the element start an initial context instance?
+            bool context( StreamPath::Tag const& tag )
+            {
+                if ( plan_.context().absolute() )
+                {
+                    return context_.enter( tag );
+                }
+                if ( level_ == 1 )
+                {
+                    // relative contexts hang off the (first) document element
+                    active_ = roots_++ == 0;
+                    return active_ and context_.start( plan_.context(), tag );
+                }
+                return active_ and context_.enter( tag );
+            }
+
+            void open( StreamPath::Tag const& tag )
+            {
+                auto const&     _columns(plan_.columns());
+                if ( spare_.empty() )
+                {
+                    rows_.push_back( Row{ 0, false, 0, std::vector<Cell>(_columns.size()), std::vector<Probe>(_columns.size()) } );
+                }
+                else
+                {
+                    rows_.push_back( std::move( spare_.back() ) );
+                    spare_.pop_back();
+                }
+                Row&            _row(rows_.back());
+                _row.level_ = level_;
+                _row.done_ = false;
+                _row.pending_ = _columns.size();
+                for ( size_t _c(0); _c < _columns.size(); ++_c )
+                {
+                    Cell&       _cell(_row.cells_[_c]);
+                    _cell.found_ = _cell.complete_ = false;
+                    _cell.value_.clear();
+                    Probe&      _probe(_row.probes_[_c]);
+                    _probe.live_ = !_probe.run_.start( _columns[_c], tag );
+                    if ( !_probe.live_ )
+                    {
+                        resolve( _row, _c, tag );
+                    }
+                }
+            }
+
+            // first match in document order for the column
+            void resolve( Row& row, size_t column, StreamPath::Tag const& tag )
+            {
+                Cell&               _cell(row.cells_[column]);
+                std::string const&  _attribute(plan_.columns()[column].attribute());
+                _cell.found_ = true;
+                if ( _attribute.empty() )
+                {
+                    _cell.level_ = level_;
+                    ++waiting_[level_];
+                }
+                else
+                {
+                    _cell.value_ = *StreamPath::find( *tag.atts_, _attribute );
+                    complete( row, _cell );
+                }
+            }
+
+            void complete( Row& row, Cell& cell )
+            {
+                cell.complete_ = true;
+                --row.pending_;
+            }
+
+            // rows go out in start order, so a row waits for earlier ones
+            void flush()
+            {
+                while ( !rows_.empty() and rows_.front().done_ )
+                {
+                    Writer<Target>  _writer(target_, label_);
+                    for ( auto const& cell : rows_.front().cells_ )
+                    {
+                        if ( cell.found_ )
+                        {
+                            _writer( cell.value_ );
+                        }
+                        else
+                        {
+                            _writer(); // no data
+                        }
+                    }
+                    spare_.push_back( std::move( rows_.front() ) );
+                    rows_.pop_front();
+                    Utility::Stats::count( Utility::Stats::Rows );
+                }
+            }
+
+            StreamPlan const&   plan_;
+            Target&             target_;
+            std::string const&  label_;
+            size_t              level_;
+            size_t              roots_;
+            PathRun             context_;
+            bool                active_;
+            std::deque<Row>     rows_;
+            std::vector<Row>    spare_;
+            std::vector<size_t> waiting_;
+            bool                stopped_;
+        };
+
+        StreamPlan const&   plan_;
+        Target&             target_;
+    };
+
+} // namespace XmlSys
@@ -0,0 +1,473 @@
+
+#pragma once
+
+#include "XmlSys/XpathAgent.h"
+#include "XmlSys/XmlStream.h"
+
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace XmlSys
+{
+    /**
+     * StreamPath.  The subset of XPath location paths that can be matched
+     * against a stream of start tags: child, self, descendant-or-self ('//')
+     * and descendant steps with name tests ('name', '*', 'node()', '.'),
+     * predicates of the form [@a] or [@a='v'], and an optional final
+     * attribute step.  compile() throws XpathAgent::BadXpath otherwise.
+     * Steps can be matched against scanner tags or against DOM nodes.
+     */
+    class StreamPath
+    {
+    public:
+        enum Axis { Child, Self, DescendantOrSelf };
+
+        struct Predicate
+        {
+            std::string     attribute_;
+            bool            compare_;
+            std::string     value_;
+        };
+
+        struct Step
+        {
+            Axis                    axis_;
+            std::string             test_;      // name, "*" (any element) or "" (any node)
+            std::vector<Predicate>  predicates_;
+        };
+
+        typedef XmlStream::Attributes   Attributes;
+
+        static std::string const* find( Attributes const& atts, std::string const& name )
+        {
+            for ( auto const& att : atts )
+            {
+                if ( att.first == name )
+                {
+                    return &att.second;
+                }
+            }
+            return nullptr;
+        }
+
+        // an element as seen by XmlStream; a null name is the document
+        struct Tag
+        {
+            std::string const*  name_;
+            Attributes const*   atts_;
+        };
+
+        static bool matches( Step const& step, Tag const& tag )
+        {
+            if ( !tag.name_ )
+            {
+                return step.test_.empty();
+            }
+            if ( !step.test_.empty() and step.test_ != "*" and step.test_ != *tag.name_ )
+            {
+                return false;
+            }
+            for ( auto const& predicate : step.predicates_ )
+            {
+                bool    _found(false);
+                for ( auto const& att : *tag.atts_ )
+                {
+                    if ( att.first == predicate.attribute_ and (!predicate.compare_ or att.second == predicate.value_) )
+                    {
+                        _found = true;
+                        break;
+                    }
+                }
+                if ( !_found )
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static bool matches( Step const& step, Xml_Node const& node )
+        {
+            if ( node.type() != pugi::node_element )
+            {
+                return step.test_.empty();
+            }
+            if ( !step.test_.empty() and step.test_ != "*" and step.test_ != node.name() )
+            {
+                return false;
+            }
+            for ( auto const& predicate : step.predicates_ )
+            {
+                Xml_Att     _att(node.attribute( predicate.attribute_.c_str() ));
+                if ( !_att or (predicate.compare_ and !equals( _att, predicate.value_ )) )
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // compares the value as the default parse options would leave it
+        static bool equals( Xml_Att const& att, std::string const& value )
+        {
+            if ( !XpathAgent::deferred() )
+            {
+                return value == att.value();
+            }
+            thread_local std::string    _buffer;
+            Utility::StringView const   _value(XpathAgent::valueOf( att, _buffer ));
+            return value.compare( 0, std::string::npos, _value.data(), _value.size() ) == 0;
+        }
+
+        static bool has_attribute( Tag const& tag, std::string const& name )
+        {
+            return tag.name_ and find( *tag.atts_, name );
+        }
+
+        static bool has_attribute( Xml_Node const& node, std::string const& name )
+        {
+            return node.attribute( name.c_str() );
+        }
+
+        static StreamPath compile( std::string const& xpath )
+        {
+            return StreamPath(xpath);
+        }
+
+        bool absolute() const { return absolute_; }
+        std::vector<Step> const& steps() const { return steps_; }
+        std::string const& attribute() const { return attribute_; }
+        std::string const& xpath() const { return xpath_; }
+
+    private:
+        explicit
+        StreamPath(std::string const& xpath)
+        : xpath_(xpath)
+        , absolute_(false)
+        , steps_()
+        , attribute_()
+        , pos_(0)
+        {
+            parse();
+        }
+
+        void unsupported( std::string const& why ) const
+        {
+            throw XpathAgent::BadXpath(xpath_, why + " (not supported in streaming mode)");
+        }
+
+        bool at( char const* token ) const
+        {
+            return xpath_.compare( pos_, std::char_traits<char>::length( token ), token ) == 0;
+        }
+
+        bool eat( char const* token )
+        {
+            if ( at( token ) )
+            {
+                pos_ += std::char_traits<char>::length( token );
+                return true;
+            }
+            return false;
+        }
+
+        void skip_space()
+        {
+            while ( pos_ < xpath_.length() and XmlText::is_space( xpath_[pos_] ) )
+            {
+                ++pos_;
+            }
+        }
+
+        static bool is_name_char( char c )
+        {
+            return std::isalnum( static_cast<unsigned char>(c) ) or c == '_' or c == '-' or c == '.' or c == ':'
+                or (static_cast<unsigned char>(c) & 0x80);
+        }
+
+        std::string name()
+        {
+            size_t      _begin(pos_);
+            while ( pos_ < xpath_.length() and is_name_char( xpath_[pos_] ) and !at( "::" ) )
+            {
+                ++pos_;
+            }
+            return xpath_.substr( _begin, pos_ - _begin );
+        }
+
+        std::string literal()
+        {
+            char        _quote(pos_ < xpath_.length() ? xpath_[pos_] : 0);
+            if ( _quote != '\'' and _quote != '"' )
+            {
+                unsupported( "predicate value must be a string literal" );
+            }
+            size_t      _end(xpath_.find( _quote, pos_ + 1 ));
+            if ( _end == std::string::npos )
+            {
+                unsupported( "unterminated literal" );
+            }
+            std::string _value(xpath_.substr( pos_ + 1, _end - pos_ - 1 ));
+            pos_ = _end + 1;
+            return _value;
+        }
+
+        void parse()
+        {
+            skip_space();
+            if ( eat( "//" ) )
+            {
+                absolute_ = true;
+                steps_.push_back( Step{ DescendantOrSelf, "", {} } );
+            }
+            else
+            if ( eat( "/" ) )
+            {
+                absolute_ = true;
+            }
+            for ( ;; )
+            {
+                step();
+                skip_space();
+                if ( pos_ == xpath_.length() )
+                {
+                    return;
+                }
+                if ( !attribute_.empty() )
+                {
+                    unsupported( "attribute step must be last" );
+                }
+                if ( eat( "//" ) )
+                {
+                    steps_.push_back( Step{ DescendantOrSelf, "", {} } );
+                }
+                else
+                if ( !eat( "/" ) )
+                {
+                    unsupported( "unexpected '" + xpath_.substr( pos_, 1 ) + "'" );
+                }
+            }
+        }
+
+        void step()
+        {
+            skip_space();
+            if ( eat( "@" ) )
+            {
+                attribute_ = name();
+                if ( attribute_.empty() )
+                {
+                    unsupported( "attribute step needs a name" );
+                }
+                return;
+            }
+            if ( at( ".." ) )
+            {
+                unsupported( "parent step" );
+            }
+            if ( eat( "." ) )
+            {
+                steps_.push_back( Step{ Self, "", {} } );
+                return;
+            }
+            Step        _step{ Child, "", {} };
+            std::string _name(eat( "*" ) ? "*" : name());
+            skip_space();
+            if ( eat( "::" ) )
+            {
+                skip_space();
+                if ( _name == "attribute" )
+                {
+                    attribute_ = name();
+                    if ( attribute_.empty() )
+                    {
+                        unsupported( "attribute step needs a name" );
+                    }
+                    return;
+                }
+                if ( _name == "self" )
+                {
+                    _step.axis_ = Self;
+                }
+                else
+                if ( _name == "descendant-or-self" )
+                {
+                    _step.axis_ = DescendantOrSelf;
+                }
+                else
+                if ( _name == "descendant" )
+                {
+                    steps_.push_back( Step{ DescendantOrSelf, "", {} } );
+                }
+                else
+                if ( _name != "child" )
+                {
+                    unsupported( "axis " + _name );
+                }
+                _name = eat( "*" ) ? "*" : name();
+                skip_space();
+            }
+            if ( eat( "(" ) )
+            {
+                skip_space();
+                if ( _name != "node" or !eat( ")" ) )
+                {
+                    unsupported( "function or node type test " + _name + "()" );
+                }
+                _name.clear();
+            }
+            else
+            if ( _name.empty() )
+            {
+                unsupported( "expected a name test" );
+            }
+            _step.test_ = _name;
+            for ( skip_space(); eat( "[" ); skip_space() )
+            {
+                skip_space();
+                if ( !eat( "@" ) )
+                {
+                    unsupported( "only [@a] and [@a='v'] predicates" );
+                }
+                Predicate   _predicate{ name(), false, "" };
+                skip_space();
+                if ( eat( "=" ) )
+                {
+                    skip_space();
+                    _predicate.compare_ = true;
+                    _predicate.value_ = literal();
+                    skip_space();
+                }
+                if ( _predicate.attribute_.empty() or !eat( "]" ) )
+                {
+                    unsupported( "only [@a] and [@a='v'] predicates" );
+                }
+                _step.predicates_.push_back( _predicate );
+            }
+            steps_.push_back( _step );
+        }
+
+        std::string         xpath_;
+        bool                absolute_;
+        std::vector<Step>   steps_;
+        std::string         attribute_;
+        size_t              pos_;
+    };
+
+    /**
+     * PathRun.  Matches one StreamPath below one anchor node, as an NFA
+     * whose state sets are kept on a stack, one set per open element.
+     * Elements are StreamPath::Tags or DOM nodes, visited in document order.
+     * State k means steps [0, k) have been matched by the element at that
+     * level (or, for a pending '//', by an ancestor of it).
+     */
+    class PathRun
+    {
+    public:
+        PathRun()
+        : path_(nullptr)
+        , states_()
+        , marks_()
+        {}
+
+        // anchor at an element or the document: true if that completes the path
+        template<typename Element>
+        bool start( StreamPath const& path, Element const& element )
+        {
+            path_ = &path;
+            states_.clear();
+            marks_.clear();
+            marks_.push_back( 0 );
+            states_.push_back( 0 );
+            return close( element );
+        }
+
+        // a child of the current element starts: true if it completes the path
+        template<typename Element>
+        bool enter( Element const& element )
+        {
+            auto const&     _steps(path_->steps());
+            size_t const    _begin(marks_.back());
+            size_t const    _end(states_.size());
+            marks_.push_back( _end );
+            for ( size_t _i(_begin); _i < _end; ++_i )
+            {
+                uint16_t    _k(states_[_i]);
+                if ( _k == _steps.size() )
+                {
+                    continue;
+                }
+                StreamPath::Step const&     _step(_steps[_k]);
+                if ( _step.axis_ == StreamPath::DescendantOrSelf )
+                {
+                    add( _k );
+                }
+                else
+                if ( _step.axis_ == StreamPath::Child and StreamPath::matches( _step, element ) )
+                {
+                    add( _k + 1 );
+                }
+            }
+            return close( element );
+        }
+
+        void leave()
+        {
+            states_.resize( marks_.back() );
+            marks_.pop_back();
+        }
+
+        // nothing below the current element can match
+        bool dead() const
+        {
+            return states_.size() == marks_.back();
+        }
+
+    private:
+        void add( uint16_t k )
+        {
+            for ( size_t _i(marks_.back()); _i < states_.size(); ++_i )
+            {
+                if ( states_[_i] == k )
+                {
+                    return;
+                }
+            }
+            states_.push_back( k );
+        }
+
+        // epsilon moves on the current element; true if the path is complete
+        template<typename Element>
+        bool close( Element const& element )
+        {
+            auto const&     _steps(path_->steps());
+            bool            _complete(false);
+            for ( size_t _i(marks_.back()); _i < states_.size(); ++_i )
+            {
+                uint16_t    _k(states_[_i]);
+                if ( _k == _steps.size() )
+                {
+                    _complete = true;
+                    continue;
+                }
+                StreamPath::Step const&     _step(_steps[_k]);
+                if ( _step.axis_ != StreamPath::Child and StreamPath::matches( _step, element ) )
+                {
+                    add( _k + 1 );
+                }
+            }
+            if ( _complete and !path_->attribute().empty() )
+            {
+                return StreamPath::has_attribute( element, path_->attribute() );
+            }
+            return _complete;
+        }
+
+        StreamPath const*       path_;
+        std::vector<uint16_t>   states_;
+        std::vector<size_t>     marks_;
+    };
+
+} // namespace XmlSys
@@ -1,6 +1,10 @@
 
 #pragma once
 
+#include "Utility/StringView.h"
+
+#include <string>
+
 namespace XmlSys
 {
     template<typename Target>
@@ -8,7 +12,7 @@ namespace XmlSys
 #ifdef NEVER_DEFINED
     {
         static void label( Target& target, std::string const& label );
-        static void item( Target& target, std::string const& item );
+        static void item( Target& target, Utility::StringView const& item ); // valid during the call only
         static void no_data( Target& target );
         static void end( Target& target );
     }
@@ -2,29 +2,43 @@
 #pragma once
 
 #include "XmlSys/XpathAgent.h"
+#include "XmlSys/PageCache.h"
+#include "Utility/Stats.h"
 #include <exception>
 #include <iostream>
+#include <memory>
 #include <sstream>
+#include <vector>
 
 namespace XmlSys
 {
     typedef pugi::xml_document      Xml_Doc;
 
+    /**
+     * DocBase.  Owns the pugixml document through a pointer, so that moving
+     * a document is cheap (pugi::xml_document itself cannot be moved, and
+     * node handles stay valid since the document does not change address).
+     * Copying still makes a deep copy.
+     */
     class DocBase
     {
     public:
         DocBase()
-        : xmlDoc_()
+        : xmlDoc_(new Xml_Doc)
         , errMsg_()
         {}
         
         DocBase(DocBase const& other)
-        : xmlDoc_()
+        : xmlDoc_(new Xml_Doc)
         , errMsg_(other.errMsg_)
         {
-            xmlDoc_.reset( other.xmlDoc_ );
+            xmlDoc_->reset( *other.xmlDoc_ );
         }
         
+        // a moved-from document may only be destroyed or assigned to
+        DocBase(DocBase&&) = default;
+        DocBase& operator= ( DocBase&& ) = default;
+        
         std::string const err_msg() const
         {
             return errMsg_;
@@ -33,13 +47,13 @@ namespace XmlSys
         template<typename Handler>
         void process_document( Handler& handler ) const
         {
-            handler( xmlDoc_ );
+            handler( *xmlDoc_ );
         }
         
         template<typename Handler>
         void process_document( Handler const& handler ) const
         {
-            handler( xmlDoc_ );
+            handler( *xmlDoc_ );
         }
         
         struct Throw
@@ -69,12 +83,12 @@ namespace XmlSys
         
         Xml_Doc& document()
         {
-            return xmlDoc_;
+            return *xmlDoc_;
         }
         
         void assign( Xml_Doc const& other )
         {
-            xmlDoc_.reset( other );
+            xmlDoc_->reset( other );
         }
         
         bool reset( std::istream& xml )
@@ -88,26 +102,66 @@ namespace XmlSys
             return parse( _xml );
         }
         
+        // parses in place: the buffer is modified and must outlive the document
+        bool reset( char* buffer, size_t size )
+        {
+            Utility::Stats::Scope   _scope(Utility::Stats::Parse);
+            return counted( check( xmlDoc_->load_buffer_inplace( buffer, size, options() ) ), size );
+        }
+        
     private:
+        // pugixml's defaults, less the decoding of values when that is
+        // left to extraction (XpathAgent::deferred)
+        static unsigned int options()
+        {
+            return XpathAgent::deferred()
+                ? pugi::parse_default & ~(pugi::parse_escapes | pugi::parse_eol | pugi::parse_wconv_attribute)
+                : pugi::parse_default
+                ;
+        }
+        
+        // parses straight into the owned document: no temporary, no copy
         bool parse( std::istream& xml )
         {
-            Xml_Doc                 _tmp;
-            pugi::xml_parse_result  _result(_tmp.load( xml ));
-            
-            if ( !_result )
+            if ( !Utility::Stats::active() )
+            {
+                return check( xmlDoc_->load( xml, options() ) );
+            }
+            // for --stats: the same load, so its reading counts as parsing;
+            // the size is known only if the stream seeks
+            Utility::Stats::Scope   _scope(Utility::Stats::Parse);
+            std::streambuf* const   _buffer(xml.rdbuf());
+            std::streampos const    _start(_buffer->pubseekoff( 0, std::ios::cur, std::ios::in ));
+            bool const              _parsed(check( xmlDoc_->load( xml, options() ) ));
+            std::streampos const    _end(_buffer->pubseekoff( 0, std::ios::cur, std::ios::in ));
+            return counted( _parsed, _start != std::streampos(-1) and _end > _start ? size_t(_end - _start) : 0 );
+        }
+        
+        static bool counted( bool parseOK, size_t size )
+        {
+            if ( parseOK )
+            {
+                Utility::Stats::count( Utility::Stats::Documents );
+                Utility::Stats::count( Utility::Stats::Bytes, size );
+            }
+            return parseOK;
+        }
+        
+        bool check( pugi::xml_parse_result const& result )
+        {
+            if ( !result )
             {
                 std::ostringstream  _error;
-                _error << "DocBase: load failure at " << _result.offset
-                       << " : " << _result.description();
+                _error << "DocBase: load failure at " << result.offset
+                       << " : " << result.description();
                 errMsg_.assign( _error.str() );
                 return false;
             }
-            assign( _tmp );
-            return true;    
+            return true;
         }
         
-        Xml_Doc         xmlDoc_;
-        std::string     errMsg_;
+        std::unique_ptr<Xml_Doc>    xmlDoc_;
+        std::string                 errMsg_;
     };
 
     template<typename ErrorPolicy = DocBase::DoNothing>
@@ -115,6 +169,12 @@ namespace XmlSys
     : public DocBase
     {
     public:
+        // empty document, to be filled by reload()
+        Document()
+        : DocBase()
+        , root_()
+        {}
+        
         explicit
         Document(std::string const& xml)
         : DocBase()
@@ -131,13 +191,40 @@ namespace XmlSys
             init( reset( xml ) );
         }
         
+        // in-place parse: buffer must outlive the document
+        Document(char* buffer, size_t size)
+        : DocBase()
+        , root_()
+        {
+            init( reset( buffer, size ) );
+        }
+        
         Document(Document const& other)
         : DocBase(other)
-        , root_(other.root_)
+        , root_(document().document_element())
         {}
         
+        Document(Document&&) = default;
+        Document& operator= ( Document&& ) = default;
+        
         ~Document() throw() {}
         
+        // reparse into the same document object
+        Document& reload( std::istream& xml )
+        {
+            root_ = Xml_Node();
+            init( reset( xml ) );
+            return *this;
+        }
+        
+        // in-place reparse: buffer must outlive the document
+        Document& reload( char* buffer, size_t size )
+        {
+            root_ = Xml_Node();
+            init( reset( buffer, size ) );
+            return *this;
+        }
+        
         template<typename Handler>
         void process_root( Handler& handler ) const
         {
@@ -162,7 +249,7 @@ namespace XmlSys
         bool has_value( XpathAgent const& agent ) const 
             { return agent.probe( root_ ); }
         bool has_value( std::string const& xpath ) const
-            { return root_.select_single_node( xpath.c_str() ); }
+            { return has_value( XpathAgent(xpath) ); }
             
         std::string const get_value( XpathAgent const& agent ) const 
             { return agent( root_ ); }
@@ -174,6 +261,11 @@ namespace XmlSys
         bool set_value( std::string const& query, std::string& target ) const 
             { return set_value( XpathAgent(query), target ); }
         
+        // the handler is given a view of the first value, if there is one
+        template<typename Handler>
+        bool first_value( XpathAgent const& agent, Handler& handler ) const
+            { return agent.value( root_, handler ); }
+        
         template<typename Inserter>
         size_t into_list( XpathAgent const& agent, Inserter inserter ) const
             { return agent( root_, inserter ); }
@@ -243,6 +335,71 @@ namespace XmlSys
     
     typedef Document<DocBase::Throw>    XmlDoc;
     
+    // immutable handle, for passing a parsed document between stages
+    typedef std::shared_ptr<XmlDoc const>   SharedDoc;
+    
+    /**
+     * DocSlot.  One document and one input buffer per thread, reparsed in
+     * place for every file so that neither is reallocated.  With PageCache
+     * installed, the pages released by the reset are taken straight back.
+     * A loaded document is valid until the next load on the same thread.
+     */
+    class DocSlot
+    {
+    public:
+        static DocSlot& local()
+        {
+            PageCache::attach(); // destroyed after the slot, at thread exit
+            thread_local DocSlot    _slot;
+            return _slot;
+        }
+        
+        XmlDoc const& load( std::istream& input )
+        {
+            size_t      _used(0);
+            size_t      _hint(0);
+            if ( input.seekg( 0, std::ios::end ) )
+            {
+                std::streamoff  _end(input.tellg());
+                input.seekg( 0, std::ios::beg );
+                _hint = _end > 0 ? static_cast<size_t>(_end) : 0;
+            }
+            input.clear();
+            if ( buffer_.size() <= _hint )
+            {
+                buffer_.resize( _hint + 1 );
+            }
+            {
+                Utility::Stats::Scope   _scope(Utility::Stats::Load);
+                while ( input.read( buffer_.data() + _used, buffer_.size() - _used ) or input.gcount() > 0 )
+                {
+                    _used += input.gcount();
+                    if ( _used < buffer_.size() )
+                    {
+                        break;
+                    }
+                    buffer_.resize( buffer_.size() * 2 );
+                }
+            }
+            return load( buffer_.data(), _used );
+        }
+        
+        XmlDoc const& load( char* buffer, size_t size )
+        {
+            PageCache::reserve( size );
+            return doc_.reload( buffer, size );
+        }
+        
+    private:
+        DocSlot()
+        : doc_()
+        , buffer_(64 * 1024)
+        {}
+        
+        XmlDoc              doc_;
+        std::vector<char>   buffer_;
+    };
+    
 } // namespace XmlSys
 
 template <typename T>
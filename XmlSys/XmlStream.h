@@ -0,0 +1,549 @@
+
+#pragma once
+
+#include "XmlSys/XmlText.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <istream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace XmlSys
+{
+    /**
+     * XmlStream.  Forward-only, DOM-free scanner for UTF-8 XML, reading
+     * either a stream (in fixed-size chunks) or a buffer in memory.  Memory
+     * use is bounded by the element nesting depth and the largest single
+     * tag or captured text.  Comments, PIs and the DOCTYPE are skipped;
+     * text and attribute values are decoded as pugixml's parse_default
+     * does (see XmlText).
+     *
+     * Handler interface:
+     *     void start( std::string const& name, Attributes const& atts );
+     *     void end();
+     *     bool capturing() const;  // wants the text of the current element?
+     *     void text( std::string const& value );
+     *     bool finished();         // stop here? (the rest is not read)
+     * Only text that pugixml would keep (CDATA, or PCDATA that is not all
+     * whitespace) is passed on, and only while the handler is capturing.
+     */
+    class XmlStream
+    {
+    public:
+        typedef std::vector<std::pair<std::string, std::string> >   Attributes;
+
+        explicit
+        XmlStream(std::istream& input, size_t chunk = 64 * 1024)
+        : input_(&input)
+        , chunk_(chunk)
+        , buffer_()
+        , base_(nullptr)
+        , cur_(nullptr)
+        , end_(nullptr)
+        , consumed_(0)
+        , errMsg_()
+        {}
+
+        XmlStream(char const* data, size_t size)
+        : input_(nullptr)
+        , chunk_(0)
+        , buffer_()
+        , base_(data)
+        , cur_(data)
+        , end_(data + size)
+        , consumed_(0)
+        , errMsg_()
+        {}
+
+        std::string const err_msg() const
+        {
+            return errMsg_;
+        }
+
+        // bytes scanned so far (after parse(), the document's size, unless
+        // the handler finished early)
+        size_t offset() const
+        {
+            return consumed_ + (cur_ - base_);
+        }
+
+        // can the scanner read this document?  Not if its byte order mark,
+        // its first bytes (as pugixml guesses: UTF-16 or UTF-32) or its
+        // declaration give another encoding than UTF-8.  Only the first
+        // chunk is read; nothing is scanned
+        bool utf8()
+        {
+            more();
+            unsigned char const*    _bytes(reinterpret_cast<unsigned char const*>(cur_));
+            size_t const            _size(end_ - cur_);
+            if ( _size >= 2 and (_bytes[0] == 0 or _bytes[1] == 0
+                or (_bytes[0] == 0xFE and _bytes[1] == 0xFF) or (_bytes[0] == 0xFF and _bytes[1] == 0xFE)) )
+            {
+                return false;
+            }
+            char const*         _begin(cur_);
+            if ( _size >= 3 and std::memcmp( _begin, "\xEF\xBB\xBF", 3 ) == 0 )
+            {
+                _begin += 3;
+            }
+            std::string const   _encoding(declared( _begin, end_ ));
+            return _encoding.empty() or _encoding == "utf-8" or _encoding == "utf8"
+                or _encoding == "us-ascii" or _encoding == "ascii";
+        }
+
+        // the input not yet scanned, read to its end (for the DOM, once
+        // utf8() has said no)
+        std::vector<char> rest()
+        {
+            std::vector<char>   _rest(cur_, end_);
+            if ( input_ )
+            {
+                _rest.insert( _rest.end(), std::istreambuf_iterator<char>(*input_), std::istreambuf_iterator<char>() );
+            }
+            consumed_ += _rest.size();
+            base_ = cur_ = end_;
+            return _rest;
+        }
+
+        template<typename Handler>
+        bool parse( Handler& handler )
+        {
+            std::vector<std::string>    _open;
+            Attributes                  _atts;
+            std::string                 _name;
+            std::string                 _raw;
+            std::string                 _value;
+            bool                        _root(false);
+
+            skip_bom();
+            for ( ;; )
+            {
+                if ( handler.finished() )
+                {
+                    return true;
+                }
+                if ( !more() )
+                {
+                    break;
+                }
+                if ( *cur_ != '<' )
+                {
+                    if ( _open.empty() or !handler.capturing() )
+                    {
+                        skip_to( '<' );
+                        continue;
+                    }
+                    _raw.clear();
+                    if ( !read_to( '<', _raw ) )
+                    {
+                        break;  // text up to the end: not a complete element
+                    }
+                    if ( !all_space( _raw ) )
+                    {
+                        _value.clear();
+                        XmlText::text( _raw.data(), _raw.data() + _raw.size(), _value );
+                        handler.text( _value );
+                    }
+                    continue;
+                }
+                ++cur_;
+                int     _c(peek());
+                if ( _c == '/' )
+                {
+                    ++cur_;
+                    read_name( _name );
+                    skip_space();
+                    if ( _open.empty() or _name != _open.back() or peek() != '>' )
+                    {
+                        return fail( "Start-end tags mismatch" );
+                    }
+                    ++cur_;
+                    _open.pop_back();
+                    handler.end();
+                }
+                else
+                if ( _c == '?' )
+                {
+                    if ( !skip_past( "?>" ) )
+                    {
+                        return fail( "Error parsing document declaration/processing instruction" );
+                    }
+                }
+                else
+                if ( _c == '!' )
+                {
+                    ++cur_;
+                    if ( match( "--" ) )
+                    {
+                        if ( !skip_past( "-->" ) )
+                        {
+                            return fail( "Error parsing comment" );
+                        }
+                    }
+                    else
+                    if ( match( "[CDATA[" ) )
+                    {
+                        _raw.clear();
+                        if ( !read_past( "]]>", _raw ) )
+                        {
+                            return fail( "Error parsing CDATA section" );
+                        }
+                        if ( !_open.empty() and handler.capturing() )
+                        {
+                            _value.clear();
+                            XmlText::text( _raw.data(), _raw.data() + _raw.size(), _value, true );
+                            handler.text( _value );
+                        }
+                    }
+                    else
+                    if ( !skip_doctype() )
+                    {
+                        return fail( "Error parsing document type declaration" );
+                    }
+                }
+                else
+                {
+                    read_name( _name );
+                    if ( _name.empty() )
+                    {
+                        return fail( "Error parsing start element tag" );
+                    }
+                    _atts.clear();
+                    bool    _empty(false);
+                    for ( ;; )
+                    {
+                        skip_space();
+                        _c = peek();
+                        if ( _c == '>' )
+                        {
+                            ++cur_;
+                            break;
+                        }
+                        if ( _c == '/' )
+                        {
+                            ++cur_;
+                            if ( peek() != '>' )
+                            {
+                                return fail( "Error parsing start element tag" );
+                            }
+                            ++cur_;
+                            _empty = true;
+                            break;
+                        }
+                        _atts.push_back( Attributes::value_type() );
+                        auto&   _att(_atts.back());
+                        read_name( _att.first );
+                        skip_space();
+                        if ( _att.first.empty() or peek() != '=' )
+                        {
+                            return fail( "Error parsing attribute" );
+                        }
+                        ++cur_;
+                        skip_space();
+                        int     _quote(peek());
+                        if ( _quote != '"' and _quote != '\'' )
+                        {
+                            return fail( "Error parsing attribute" );
+                        }
+                        ++cur_;
+                        _raw.clear();
+                        if ( !read_past( _quote == '"' ? "\"" : "'", _raw ) )
+                        {
+                            return fail( "Error parsing attribute" );
+                        }
+                        XmlText::attribute( _raw.data(), _raw.data() + _raw.size(), _att.second );
+                    }
+                    _root = true;
+                    handler.start( _name, _atts );
+                    if ( _empty )
+                    {
+                        handler.end();
+                    }
+                    else
+                    {
+                        _open.push_back( _name );
+                    }
+                }
+            }
+            if ( !_open.empty() )
+            {
+                return fail( "Start-end tags mismatch" );
+            }
+            if ( !_root )
+            {
+                return fail( "No document element found" );
+            }
+            return true;
+        }
+
+    private:
+        XmlStream(XmlStream const&) = delete;
+        XmlStream& operator= ( XmlStream const& ) = delete;
+
+        bool fail( char const* what )
+        {
+            std::ostringstream  _error;
+            _error << "XmlStream: parse failure at " << offset() << " : " << what;
+            errMsg_.assign( _error.str() );
+            return false;
+        }
+
+        // ensures at least one unread byte, refilling from the stream
+        bool more()
+        {
+            if ( cur_ < end_ )
+            {
+                return true;
+            }
+            if ( !input_ )
+            {
+                return false;
+            }
+            consumed_ += end_ - base_;
+            buffer_.resize( chunk_ );
+            input_->read( &buffer_[0], chunk_ );
+            buffer_.resize( input_->gcount() );
+            base_ = cur_ = buffer_.data();
+            end_ = cur_ + buffer_.size();
+            return cur_ < end_;
+        }
+
+        int peek()
+        {
+            return more() ? static_cast<unsigned char>(*cur_) : -1;
+        }
+
+        void skip_bom()
+        {
+            match( "\xEF\xBB\xBF" );
+        }
+
+        // the encoding named by an XML declaration at begin, lower case
+        // (empty if there is none, or it names none)
+        static std::string declared( char const* begin, char const* end )
+        {
+            static char const   _xml[] = "<?xml";
+            static char const   _name[] = "encoding";
+            size_t const        _length(end - begin);
+            if ( _length < sizeof(_xml) or std::memcmp( begin, _xml, sizeof(_xml) - 1 ) != 0
+                or !XmlText::is_space( begin[sizeof(_xml) - 1] ) )
+            {
+                return std::string();
+            }
+            char const*     _stop(std::search( begin, end, "?>", "?>" + 2 ));
+            char const*     _at(std::search( begin, _stop, _name, _name + sizeof(_name) - 1 ));
+            if ( _at == _stop )
+            {
+                return std::string();
+            }
+            _at += sizeof(_name) - 1;
+            while ( _at < _stop and (XmlText::is_space( *_at ) or *_at == '=') )
+            {
+                ++_at;
+            }
+            if ( _at == _stop or (*_at != '"' and *_at != '\'') )
+            {
+                return std::string();
+            }
+            char const*     _close(std::find( _at + 1, _stop, *_at ));
+            std::string     _encoding(_at + 1, _close);
+            for ( auto& c : _encoding )
+            {
+                c = std::tolower( static_cast<unsigned char>(c) );
+            }
+            return _encoding;
+        }
+
+        void skip_space()
+        {
+            while ( more() and XmlText::is_space( *cur_ ) )
+            {
+                ++cur_;
+            }
+        }
+
+        static bool is_name( char c )
+        {
+            return !XmlText::is_space( c ) and !std::strchr( "/>=<\"'?!", c );
+        }
+
+        void read_name( std::string& name )
+        {
+            name.clear();
+            while ( more() )
+            {
+                char const*     _run(cur_);
+                while ( cur_ < end_ and is_name( *cur_ ) )
+                {
+                    ++cur_;
+                }
+                name.append( _run, cur_ );
+                if ( cur_ < end_ )
+                {
+                    return;
+                }
+            }
+        }
+
+        void skip_to( char c )
+        {
+            while ( more() )
+            {
+                char const*     _hit(static_cast<char const*>(std::memchr( cur_, c, end_ - cur_ )));
+                if ( _hit )
+                {
+                    cur_ = _hit;
+                    return;
+                }
+                cur_ = end_;
+            }
+        }
+
+        // false if the input ends first
+        bool read_to( char c, std::string& out )
+        {
+            while ( more() )
+            {
+                char const*     _hit(static_cast<char const*>(std::memchr( cur_, c, end_ - cur_ )));
+                out.append( cur_, _hit ? _hit : end_ );
+                if ( _hit )
+                {
+                    cur_ = _hit;
+                    return true;
+                }
+                cur_ = end_;
+            }
+            return false;
+        }
+
+        // consumes the literal if it comes next; a partial match across a
+        // chunk boundary is not consumed
+        bool match( char const* literal )
+        {
+            size_t      _length(std::strlen( literal ));
+            if ( !more() )
+            {
+                return false;
+            }
+            if ( static_cast<size_t>(end_ - cur_) < _length and input_ )
+            {
+                // move the tail to the front and top up the buffer
+                std::string     _tail(cur_, end_);
+                consumed_ += cur_ - base_;
+                buffer_.assign( _tail.begin(), _tail.end() );
+                buffer_.resize( _tail.size() + chunk_ );
+                input_->read( &buffer_[_tail.size()], chunk_ );
+                buffer_.resize( _tail.size() + input_->gcount() );
+                base_ = cur_ = buffer_.data();
+                end_ = cur_ + buffer_.size();
+            }
+            if ( static_cast<size_t>(end_ - cur_) >= _length and std::memcmp( cur_, literal, _length ) == 0 )
+            {
+                cur_ += _length;
+                return true;
+            }
+            return false;
+        }
+
+        // reads up to the terminator (not included), then skips it
+        bool read_past( char const* terminator, std::string& out )
+        {
+            while ( more() )
+            {
+                char const*     _hit(static_cast<char const*>(std::memchr( cur_, terminator[0], end_ - cur_ )));
+                if ( !_hit )
+                {
+                    out.append( cur_, end_ );
+                    cur_ = end_;
+                    continue;
+                }
+                out.append( cur_, _hit );
+                cur_ = _hit;
+                if ( match( terminator ) )
+                {
+                    return true;
+                }
+                out += *cur_++;
+            }
+            return false;
+        }
+
+        bool skip_past( char const* terminator )
+        {
+            while ( more() )
+            {
+                skip_to( terminator[0] );
+                if ( match( terminator ) )
+                {
+                    return true;
+                }
+                if ( more() )
+                {
+                    ++cur_;
+                }
+            }
+            return false;
+        }
+
+        // <!DOCTYPE ...> with an optional [internal subset]
+        bool skip_doctype()
+        {
+            int     _depth(0);
+            while ( more() )
+            {
+                char    _c(*cur_++);
+                if ( _c == '[' )
+                {
+                    ++_depth;
+                }
+                else
+                if ( _c == ']' )
+                {
+                    --_depth;
+                }
+                else
+                if ( _c == '>' and _depth <= 0 )
+                {
+                    return true;
+                }
+                else
+                if ( _c == '"' or _c == '\'' )
+                {
+                    char const  _quote[2] = { _c, 0 };
+                    if ( !skip_past( _quote ) )
+                    {
+                        return false;
+                    }
+                }
+            }
+            return false;
+        }
+
+        static bool all_space( std::string const& raw )
+        {
+            for ( char c : raw )
+            {
+                if ( !XmlText::is_space( c ) )
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        std::istream*       input_;
+        size_t const        chunk_;
+        std::string         buffer_;
+        char const*         base_;
+        char const*         cur_;
+        char const*         end_;
+        size_t              consumed_;
+        std::string         errMsg_;
+    };
+
+} // namespace XmlSys
@@ -0,0 +1,165 @@
+
+#pragma once
+
+#include <string>
+
+namespace XmlSys
+{
+    /**
+     * XmlText.  Decodes raw character data the way pugixml's default parse
+     * options do: predefined entity and character references are replaced
+     * (unrecognised ones are kept verbatim), CR LF and lone CR become LF in
+     * text, and TAB, CR LF, CR and LF become a single space in attribute
+     * values.  Output is appended.
+     */
+    struct XmlText
+    {
+        static void append_utf8( std::string& out, unsigned int code )
+        {
+            if ( code < 0x80 )
+            {
+                out += static_cast<char>(code);
+            }
+            else
+            if ( code < 0x800 )
+            {
+                out += static_cast<char>(0xC0 | (code >> 6));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            }
+            else
+            if ( code < 0x10000 )
+            {
+                out += static_cast<char>(0xE0 | (code >> 12));
+                out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            }
+            else
+            {
+                out += static_cast<char>(0xF0 | ((code >> 18) & 0x07));
+                out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+                out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            }
+        }
+
+        // s points at '&': appends the replacement and returns the position
+        // after the reference, or appends '&' alone if it is not recognised
+        static char const* escape( char const* s, char const* end, std::string& out )
+        {
+            char const*     _p(s + 1);
+
+            if ( _p < end and *_p == '#' )
+            {
+                unsigned int    _code(0);
+                bool            _hex(++_p < end and *_p == 'x');
+                if ( _hex )
+                {
+                    ++_p;
+                }
+                char const*     _digits(_p);
+                for ( ; _p < end and *_p != ';'; ++_p )
+                {
+                    unsigned int    _c(static_cast<unsigned char>(*_p));
+                    if ( _c - '0' <= 9 )
+                    {
+                        _code = (_hex ? 16 : 10) * _code + (_c - '0');
+                    }
+                    else
+                    if ( _hex and (_c | ' ') - 'a' <= 5 )
+                    {
+                        _code = 16 * _code + ((_c | ' ') - 'a' + 10);
+                    }
+                    else
+                    {
+                        break;
+                    }
+                }
+                if ( _p < end and *_p == ';' and _p != _digits )
+                {
+                    append_utf8( out, _code );
+                    return _p + 1;
+                }
+            }
+            else
+            {
+                static struct { char const* name_; size_t length_; char value_; } const   _named[] =
+                {
+                    { "amp;", 4, '&' }, { "apos;", 5, '\'' }, { "gt;", 3, '>' }, { "lt;", 3, '<' }, { "quot;", 5, '"' }
+                };
+                for ( auto const& named : _named )
+                {
+                    if ( static_cast<size_t>(end - _p) >= named.length_ and std::char_traits<char>::compare( _p, named.name_, named.length_ ) == 0 )
+                    {
+                        out += named.value_;
+                        return _p + named.length_;
+                    }
+                }
+            }
+            out += '&';
+            return s + 1;
+        }
+
+        // element text (PCDATA or CDATA); CDATA has no references
+        static void text( char const* begin, char const* end, std::string& out, bool cdata = false )
+        {
+            while ( begin < end )
+            {
+                char const*     _run(begin);
+                while ( begin < end and *begin != '\r' and (cdata or *begin != '&') )
+                {
+                    ++begin;
+                }
+                out.append( _run, begin );
+                if ( begin == end )
+                {
+                    break;
+                }
+                if ( *begin == '\r' )
+                {
+                    out += '\n';
+                    if ( ++begin < end and *begin == '\n' )
+                    {
+                        ++begin;
+                    }
+                }
+                else
+                {
+                    begin = escape( begin, end, out );
+                }
+            }
+        }
+
+        static void attribute( char const* begin, char const* end, std::string& out )
+        {
+            while ( begin < end )
+            {
+                char const*     _run(begin);
+                while ( begin < end and *begin != '&' and *begin != '\r' and *begin != '\n' and *begin != '\t' )
+                {
+                    ++begin;
+                }
+                out.append( _run, begin );
+                if ( begin == end )
+                {
+                    break;
+                }
+                if ( *begin == '&' )
+                {
+                    begin = escape( begin, end, out );
+                    continue;
+                }
+                out += ' ';
+                if ( *begin++ == '\r' and begin < end and *begin == '\n' )
+                {
+                    ++begin;
+                }
+            }
+        }
+
+        static bool is_space( char c )
+        {
+            return c == ' ' or c == '\t' or c == '\n' or c == '\r';
+        }
+    };
+
+} // namespace XmlSys
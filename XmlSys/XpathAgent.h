@@ -1,10 +1,19 @@
 
 #pragma once
 
+#include "XmlSys/XmlText.h"
+#include "Utility/StringView.h"
+
 #include <pugixml.hpp>
 #include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <functional>
+#include <exception>
+#include <memory>
+#include <sstream>
 #include <string>
+#include <vector>
 
 namespace XmlSys
 {
@@ -12,12 +21,22 @@ namespace XmlSys
     typedef pugi::xml_attribute     Xml_Att;
     typedef pugi::xpath_node        Xpath_Node;
     typedef pugi::xpath_node_set    Xpath_NodeSet;
+    typedef pugi::xpath_query       Xpath_Query;
     
     /**
      * XpathAgent.  Class to simplify processing of xpath queries applied
      * to nodes in a document.
      * Compound queries of the form this-node-or-that-attribute are not 
      * supported.  The intent can be achieved by using two separate queries.
+     * The query is compiled once, at construction, and shared (immutably)
+     * between copies; evaluation of a compiled query is thread-safe.
+     * Plain relative paths of element names, optionally ending in an
+     * attribute ('a/b/c', './a/@id') are evaluated by walking child
+     * elements directly, in document order, instead of by the XPath
+     * engine; the results are the same.
+     * With deferred() set, documents are parsed with their values left
+     * as they are in the input (references, CRs and tabs included), and
+     * each value is decoded when it is extracted instead (see valueOf).
      */
     class XpathAgent
     {
@@ -34,54 +53,213 @@ namespace XmlSys
             ;
         }
         
+        // is decoding left to extraction?  Set before any document is
+        // parsed, and only if every query in use is deferrable()
+        static bool& deferred()
+        {
+            static bool     _deferred(false);
+            return _deferred;
+        }
+        
+        // heuristic: predicates and function calls (bar node type tests)
+        // may look at values; plain location paths only look at names
+        static bool readsValues( std::string const& xpath )
+        {
+            std::string     _rest(xpath);
+            for ( std::string const test : { "node()", "text()", "comment()" } )
+            {
+                for ( size_t _pos(_rest.find( test )); _pos != std::string::npos; _pos = _rest.find( test, _pos ) )
+                {
+                    _rest.erase( _pos, test.size() );
+                }
+            }
+            return _rest.find_first_of( "[(" ) != std::string::npos;
+        }
+        
+        // the text of an element, as child_value() would give it after a
+        // parse with the default options: a deferred value that holds a
+        // reference or a CR is decoded into the buffer, which the result
+        // then points into; any other value is returned as it is
+        static Utility::StringView valueOf( Xml_Node const& node, std::string& buffer )
+        {
+            if ( !deferred() )
+            {
+                return node.child_value();
+            }
+            for ( Xml_Node _child(node.first_child()); _child; _child = _child.next_sibling() )
+            {
+                if ( _child.type() == pugi::node_pcdata or _child.type() == pugi::node_cdata )
+                {
+                    bool const  _cdata(_child.type() == pugi::node_cdata);
+                    return decoded_( _child.value(), _cdata ? "\r" : "&\r", buffer, [&]( char const* begin, char const* end ) -> void
+                    {
+                        XmlText::text( begin, end, buffer, _cdata );
+                    } );
+                }
+            }
+            return Utility::StringView();
+        }
+        
+        // an attribute value, likewise (TAB and LF are converted as well)
+        static Utility::StringView valueOf( Xml_Att const& att, std::string& buffer )
+        {
+            if ( !deferred() )
+            {
+                return att.value();
+            }
+            return decoded_( att.value(), "&\r\n\t", buffer, [&]( char const* begin, char const* end ) -> void
+            {
+                XmlText::attribute( begin, end, buffer );
+            } );
+        }
+        
         static std::string const fromAttribute( Xpath_Node const& xpnode )
         {
-            return xpnode.attribute().as_string();
+            std::string     _buffer;
+            return valueOf( xpnode.attribute(), _buffer ).str();
         }
         
         static std::string const fromNode( Xpath_Node const& xpnode )
         {
-            return xpnode.node().child_value();
+            std::string     _buffer;
+            return valueOf( xpnode.node(), _buffer ).str();
+        }
+        
+        struct BadXpath
+        : public std::exception
+        {
+            std::string     msg_;
+            
+            BadXpath(std::string const& xpath, std::string const& reason)
+            : msg_("XpathAgent: bad xpath [" + xpath + "] : " + reason)
+            {}
+            
+            const char* what() const noexcept override
+            {
+                return msg_.c_str();
+            }
+        };
+        
+        // throws BadXpath if the expression does not compile to a node set
+        static std::shared_ptr<Xpath_Query const> compile( std::string const& xpath )
+        {
+            try
+            {
+                std::shared_ptr<Xpath_Query const>  _query(new Xpath_Query(xpath.c_str()));
+                if ( _query->return_type() != pugi::xpath_type_node_set )
+                {
+                    throw BadXpath(xpath, "expression does not select nodes");
+                }
+                return _query;
+            }
+            catch ( pugi::xpath_exception const& ex )
+            {
+                std::ostringstream  _oss;
+                _oss << ex.result().description() << " at " << ex.result().offset;
+                throw BadXpath(xpath, _oss.str());
+            }
+        }
+        
+        // splits 'a/b/c', './a/b' or 'a/@id' into element names and the
+        // final attribute name; false for anything else
+        static bool simplePath( std::string const& xpath, std::vector<std::string>& names, std::string& attribute )
+        {
+            auto    _isName([]( std::string const& name ) -> bool
+            {
+                if ( name.empty() or !(std::isalpha( static_cast<unsigned char>(name[0]) ) or name[0] == '_') )
+                {
+                    return false;
+                }
+                for ( char c : name )
+                {
+                    if ( !(std::isalnum( static_cast<unsigned char>(c) ) or c == '_' or c == '-' or c == '.' or c == ':') )
+                    {
+                        return false;
+                    }
+                }
+                // node type tests and axes are not names here
+                return name.find( "::" ) == std::string::npos;
+            });
+            
+            names.clear();
+            attribute.clear();
+            size_t      _pos(xpath.compare( 0, 2, "./" ) == 0 ? 2 : 0);
+            for ( ;; )
+            {
+                size_t          _end(xpath.find( '/', _pos ));
+                std::string     _step(xpath.substr( _pos, _end == std::string::npos ? _end : _end - _pos ));
+                if ( _end == std::string::npos and _step.size() > 1 and _step[0] == '@' and _isName( _step.substr( 1 ) ) )
+                {
+                    attribute = _step.substr( 1 );
+                    return true;
+                }
+                if ( !_isName( _step ) )
+                {
+                    return false;
+                }
+                names.push_back( _step );
+                if ( _end == std::string::npos )
+                {
+                    return true;
+                }
+                _pos = _end + 1;
+            }
         }
         
         explicit
         XpathAgent(std::string const& xpath)
         : xpath_(xpath)
         , fromAtt_(selectsAttribute( xpath ))
+        , query_(compile( xpath ))
+        , names_()
+        , attribute_()
+        , simple_(simplePath( xpath, names_, attribute_ ) and fromAtt_ == !attribute_.empty())
         {}
         
         XpathAgent(std::string const& xpath, bool fromAtt)
         : xpath_(xpath)
         , fromAtt_(fromAtt)
+        , query_(compile( xpath ))
+        , names_()
+        , attribute_()
+        , simple_(simplePath( xpath, names_, attribute_ ) and fromAtt_ == !attribute_.empty())
         {}
+        
+        std::string const& xpath() const { return xpath_; }
+        bool fromAtt() const { return fromAtt_; }
+
+        // gives the same results on a deferred document
+        bool deferrable() const { return simple_ or !readsValues( xpath_ ); }
 
         bool probe( Xml_Node const& root ) const 
         {
-            return root.select_single_node( xpath_.c_str() );
+            return first_( root );
         }
         
         // canonical operation: extract string from first eligible node.
         std::string const operator () ( Xml_Node const& root ) const
         {
-            Xpath_Node      _xpnode(root.select_single_node( xpath_.c_str() ));
-            return _xpnode ? extract_( _xpnode ) : "";
+            Xpath_Node      _xpnode(first_( root ));
+            return _xpnode ? extract_( _xpnode ).str() : std::string();
         }
         // COM style
         bool operator () ( Xml_Node const& root, std::string& target ) const
         {
-            Xpath_Node      _xpnode(root.select_single_node( xpath_.c_str() ));
+            Xpath_Node      _xpnode(first_( root ));
             if ( _xpnode )
             {
-                target.assign( extract_( _xpnode ) );
+                Utility::StringView     _value(extract_( _xpnode ));
+                target.assign( _value.data(), _value.size() );
                 return true;
             }
             return false;
         }
         
+        // the handler is given a view into the document, not a copy
         template<typename Handler>
         bool value( Xml_Node const& root, Handler& handler ) const
         {
-            Xpath_Node      _xpnode(root.select_single_node( xpath_.c_str() ));
+            Xpath_Node      _xpnode(first_( root ));
             if ( _xpnode )
             {
                 handler( extract_( _xpnode ) );
@@ -92,9 +270,9 @@ namespace XmlSys
         }
 
         template<typename Handler>
-        void node( Xml_Node const& root, Handler& handler ) const
+        bool node( Xml_Node const& root, Handler& handler ) const
         {
-            Xpath_Node      _xpnode(root.select_single_node( xpath_.c_str() ));
+            Xpath_Node      _xpnode(first_( root ));
             if ( _xpnode )
             {
                 handler( _xpnode.node() );
@@ -105,9 +283,9 @@ namespace XmlSys
         }
 
         template<typename Handler>
-        void attribute( Xml_Node const& root, Handler& handler ) const
+        bool attribute( Xml_Node const& root, Handler& handler ) const
         {
-            Xpath_Node      _xpnode(root.select_single_node( xpath_.c_str() ));
+            Xpath_Node      _xpnode(first_( root ));
             if ( _xpnode )
             {
                 handler( _xpnode.attribute() );
@@ -117,102 +295,144 @@ namespace XmlSys
             
         }
 
-        // pass extracted strings from all eligible nodes to an inserter
+        // pass extracted values (Utility::StringViews, which convert to
+        // std::string) from all eligible nodes to an inserter
         template <typename Inserter>
         size_t operator () ( Xml_Node const& root, Inserter inserter ) const
         {
-            Xpath_NodeSet       _xpset(root.select_nodes( xpath_.c_str() ));
-            if ( _xpset.size() > 0 )
+            return each_( root, [&]( Xpath_Node const& xpnode ) -> void
             {
-                if ( fromAtt_ )
-                {
-                    std::transform( _xpset.begin(), _xpset.end(), inserter, fromAttribute );
-                }
-                else
-                {
-                    std::transform( _xpset.begin(), _xpset.end(), inserter, fromNode ); 
-                }
-            }
-            return _xpset.size();
-             
+                *inserter++ = extract_( xpnode );
+            } );
+
         }
         
         // generic operations on members of result sets.
         template <typename Handler>
         size_t apply( Xml_Node const& root, Handler& handler ) const
         {
-            Xpath_NodeSet       _xpset(root.select_nodes( xpath_.c_str() ));
-            for ( auto const& xpnode : _xpset )
-            {
-                handler( xpnode.node() );
-            }
-            return _xpset.size();           
+            return each_( root, [&]( Xpath_Node const& xpnode ) -> void { handler( xpnode.node() ); } );
         }
 
         template <typename Handler>
         size_t apply( Xml_Node const& root, Handler& handler, bool /* discriminator */ ) const
         {
-            Xpath_NodeSet       _xpset(root.select_nodes( xpath_.c_str() ));
-            for ( auto const& xpnode : _xpset )
-            {
-                handler( xpnode.attribute() );
-            }
-            return _xpset.size();           
+            return each_( root, [&]( Xpath_Node const& xpnode ) -> void { handler( xpnode.attribute() ); } );
         }
 
         template <typename Handler>
         size_t apply_raw( Xml_Node const& root, Handler& handler ) const
         {
-            Xpath_NodeSet       _xpset(root.select_nodes( xpath_.c_str() ));
-            for ( auto const& xpnode : _xpset )
-            {
-                handler( xpnode );
-            }
-            return _xpset.size();           
+            return each_( root, [&]( Xpath_Node const& xpnode ) -> void { handler( xpnode ); } );
         }
         
         // const handler variants
         template <typename Handler>
         size_t apply( Xml_Node const& root, Handler const& handler ) const
         {
-            Xpath_NodeSet       _xpset(root.select_nodes( xpath_.c_str() ));
-            for ( auto const& xpnode : _xpset )
-            {
-                handler( xpnode.node() );
-            }
-            return _xpset.size();           
+            return each_( root, [&]( Xpath_Node const& xpnode ) -> void { handler( xpnode.node() ); } );
         }
 
         template <typename Handler>
         size_t apply( Xml_Node const& root, Handler const& handler, bool /* discriminator */ ) const
         {
-            Xpath_NodeSet       _xpset(root.select_nodes( xpath_.c_str() ));
-            for ( auto const& xpnode : _xpset )
-            {
-                handler( xpnode.attribute() );
-            }
-            return _xpset.size();           
+            return each_( root, [&]( Xpath_Node const& xpnode ) -> void { handler( xpnode.attribute() ); } );
         }
 
         template <typename Handler>
         size_t apply_raw( Xml_Node const& root, Handler const& handler ) const
         {
-            Xpath_NodeSet       _xpset(root.select_nodes( xpath_.c_str() ));
-            for ( auto const& xpnode : _xpset )
+            return each_( root, [&]( Xpath_Node const& xpnode ) -> void { handler( xpnode ); } );
+        }
+        
+    private:
+        // a decoded value lasts until the calling thread's next extraction
+        Utility::StringView extract_( Xpath_Node const& xpnode ) const
+        {
+            if ( !deferred() )
             {
-                handler( xpnode );
+                return fromAtt_ ? xpnode.attribute().as_string() : xpnode.node().child_value(); 
             }
-            return _xpset.size();           
+            thread_local std::string    _buffer;
+            return fromAtt_ ? valueOf( xpnode.attribute(), _buffer ) : valueOf( xpnode.node(), _buffer );
         }
         
-    private:
-        std::string const extract_( Xpath_Node const& xpnode ) const
+        // decodes the value only if it holds one of the special characters;
+        // a decoded reference to NUL ends the value, as it would in place
+        template<typename Decoder>
+        static Utility::StringView decoded_( char const* value, char const* specials, std::string& buffer, Decoder decoder )
         {
-            return fromAtt_ ? xpnode.attribute().as_string() : xpnode.node().child_value(); 
+            char const*     _special(std::strpbrk( value, specials ));
+            if ( !_special )
+            {
+                return value;
+            }
+            buffer.assign( value, _special );
+            decoder( _special, _special + std::strlen( _special ) );
+            return buffer.c_str();
+        }
+        
+        // depth-first over the named children: document order, no duplicates;
+        // the visitor returns false to stop
+        template<typename Visitor>
+        bool walk_( Xml_Node const& node, size_t depth, Visitor& visitor ) const
+        {
+            if ( depth == names_.size() )
+            {
+                if ( attribute_.empty() )
+                {
+                    return visitor( Xpath_Node(node) );
+                }
+                Xml_Att     _att(node.attribute( attribute_.c_str() ));
+                return !_att or visitor( Xpath_Node(_att, node) );
+            }
+            char const*     _name(names_[depth].c_str());
+            for ( Xml_Node _child(node.child( _name )); _child; _child = _child.next_sibling( _name ) )
+            {
+                if ( !walk_( _child, depth + 1, visitor ) )
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        
+        Xpath_Node first_( Xml_Node const& root ) const
+        {
+            if ( !simple_ )
+            {
+                return root.select_single_node( *query_ );
+            }
+            Xpath_Node      _first;
+            auto            _visitor([&]( Xpath_Node const& xpnode ) -> bool { _first = xpnode; return false; });
+            walk_( root, 0, _visitor );
+            return _first;
+        }
+        
+        template<typename Handler>
+        size_t each_( Xml_Node const& root, Handler handler ) const
+        {
+            if ( !simple_ )
+            {
+                Xpath_NodeSet   _xpset(root.select_nodes( *query_ ));
+                for ( auto const& xpnode : _xpset )
+                {
+                    handler( xpnode );
+                }
+                return _xpset.size();
+            }
+            size_t          _count(0);
+            auto            _visitor([&]( Xpath_Node const& xpnode ) -> bool { handler( xpnode ); ++_count; return true; });
+            walk_( root, 0, _visitor );
+            return _count;
         }
         
-        std::string     xpath_;
-        bool            fromAtt_;
+        std::string                         xpath_;
+        bool                                fromAtt_;
+        std::shared_ptr<Xpath_Query const>  query_;
+        std::vector<std::string>            names_;     // simple path: element steps
+        std::string                         attribute_; // and final attribute, if any
+        bool                                simple_;
     };
     
 } // namespace XmlSys
@@ -0,0 +1,15 @@
+
+#include "Bench.h"
+
+    int main( int ac, char *av[] )
+    {
+        try
+        {
+            return XpBench().run( ac, av );
+        }
+        catch ( std::exception& e )
+        {
+            std::cerr << "Exception caught (and exiting): " << e.what() << std::endl; 
+            return 1;
+        }
+    }
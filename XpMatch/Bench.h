@@ -0,0 +1,1456 @@
+
+#pragma once
+
+#include "OutputMethods.h"
+#include "XmlSys/Mappers.h"
+#include "XmlSys/StreamMapper.h"
+#include "Utility/JsonText.h"
+#include "Utility/ProgramOptions.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+namespace Bench
+{
+    /**
+     * Random.  xorshift64*, which gives the same sequence with every
+     * compiler and library (unlike the std distributions), so that a
+     * corpus is byte for byte the same wherever it is generated.
+     */
+    class Random
+    {
+    public:
+        explicit
+        Random(uint64_t seed)
+        : state_(seed ? seed : 1)
+        {}
+
+        uint64_t operator() ()
+        {
+            state_ ^= state_ >> 12;
+            state_ ^= state_ << 25;
+            state_ ^= state_ >> 27;
+            return state_ * 0x2545F4914F6CDD1DULL;
+        }
+
+        size_t below( size_t bound ) { return (*this)() % bound; }
+
+        char const* word()
+        {
+            static char const* const    _words[] =
+            {
+                "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+                "india", "juliet", "kilo", "lima", "mike", "november", "oscar", "papa",
+                "quebec", "romeo", "sierra", "tango", "uniform", "victor", "whiskey", "xray",
+                "yankee", "zulu", "amber", "basalt", "cobalt", "dune", "ember", "flint",
+            };
+            return _words[below( sizeof _words / sizeof _words[0] )];
+        }
+
+        // n words, with an escaped character now and then
+        std::string const words( size_t n )
+        {
+            std::string     _text;
+            for ( size_t _w(0); _w < n; ++_w )
+            {
+                _text += _w == 0 ? "" : below( 16 ) == 0 ? " &amp; " : below( 32 ) == 0 ? " &lt; " : " ";
+                _text += word();
+            }
+            return _text;
+        }
+
+    private:
+        uint64_t    state_;
+    };
+
+    /**
+     * Shape.  One kind of corpus: how its files are generated, and what
+     * the benchmarks evaluate on it (a grep xpath; a table spec, in -t
+     * file format, with its initial context).  'records' is the number of
+     * repeated units per file; scale multiplies the number of files, or,
+     * for a shape of a few huge files, the records per file.
+     */
+    struct Shape
+    {
+        typedef void (*Writer)( std::ostream&, Random&, size_t records );
+
+        char const*                 name_;
+        size_t                      files_;
+        size_t                      records_;
+        bool                        huge_;
+        Writer                      write_;
+        char const*                 xpath_;
+        char const*                 context_;
+        std::vector<std::string>    spec_;
+
+        static std::vector<Shape> const& all()
+        {
+            static std::vector<Shape> const     _shapes =
+            {
+                // many small files
+                { "small", 2000, 4, false, &small, "//item/@sku", "/order",
+                  { "Id @id", "Name customer/name", "City customer/address/city",
+                    "Sku items/item/@sku", "Price .//price", "Total total" } },
+                // a few huge files
+                { "huge", 2, 60000, true, &huge, "//record[@type='alpha']/title", "/feed/record",
+                  { "Id @id", "Type @type", "Title title", "Value value", "Tag tags/tag" } },
+                // deep nesting
+                { "deep", 100, 200, false, &deep, "//leaf", "//n[@d mod 50 = 0]",
+                  { "Depth @d", "Value v", "Leaf .//leaf" } },
+                // wide: very many siblings
+                { "wide", 20, 20000, false, &wide, "/root/e[@i > 19000]", "/root/e",
+                  { "I @i", "Value ." } },
+                // attribute-heavy
+                { "attrs", 200, 200, false, &attrs, "//rec/@a7", "/set/rec",
+                  { "A1 @a1", "A2 @a2", "A3 @a3", "A4 @a4", "A5 @a5", "A6 @a6",
+                    "A7 @a7", "A8 @a8", "A9 @a9", "A10 @a10", "A11 @a11", "A12 @a12" } },
+                // text-heavy
+                { "text", 200, 40, false, &text, "//para[@lang='de']", "/doc/para",
+                  { "Lang @lang", "Title @title", "Body ." } },
+            };
+            return _shapes;
+        }
+
+        // the random values of each unit are drawn in separate statements:
+        // operands of one << chain may be evaluated in any order
+        static void small( std::ostream& os, Random& random, size_t records )
+        {
+            os << "<order id=\"" << random.below( 1000000 ) << "\">";
+            os << "<customer><name>" << random.words( 2 ) << "</name>";
+            os << "<address><city>" << random.word() << "</city>";
+            os << "<zip>" << 10000 + random.below( 90000 ) << "</zip></address></customer><items>";
+            size_t      _total(0);
+            for ( size_t _r(0); _r < records; ++_r )
+            {
+                size_t const    _price(random.below( 100000 ));
+                _total += _price;
+                os << "<item sku=\"SKU-" << random.below( 100000 ) << "\"";
+                os << " qty=\"" << 1 + random.below( 9 ) << "\">";
+                os << "<desc>" << random.words( 8 ) << "</desc>";
+                os << "<price>" << money( _price ) << "</price></item>";
+            }
+            os << "</items><total>" << money( _total ) << "</total></order>\n";
+        }
+
+        static std::string const money( size_t cents )
+        {
+            char    _text[32];
+            std::snprintf( _text, sizeof _text, "%zu.%02zu", cents / 100, cents % 100 );
+            return _text;
+        }
+
+        static void huge( std::ostream& os, Random& random, size_t records )
+        {
+            os << "<feed>\n";
+            for ( size_t _r(0); _r < records; ++_r )
+            {
+                os << "<record id=\"" << _r << "\" type=\"" << random.word() << "\">";
+                os << "<title>" << random.words( 6 ) << "</title>";
+                os << "<value>" << random.below( 1000000 ) << "</value><tags>";
+                for ( size_t _t(0), _tags(1 + random.below( 4 )); _t < _tags; ++_t )
+                {
+                    os << "<tag>" << random.word() << "</tag>";
+                }
+                os << "</tags></record>\n";
+            }
+            os << "</feed>\n";
+        }
+
+        static void deep( std::ostream& os, Random& random, size_t records )
+        {
+            for ( size_t _d(0); _d < records; ++_d )
+            {
+                os << "<n d=\"" << _d << "\"><v>" << random.word() << "</v>";
+            }
+            os << "<leaf>" << random.words( 3 ) << "</leaf>";
+            for ( size_t _d(0); _d < records; ++_d )
+            {
+                os << "</n>";
+            }
+            os << '\n';
+        }
+
+        static void wide( std::ostream& os, Random& random, size_t records )
+        {
+            os << "<root>\n";
+            for ( size_t _r(0); _r < records; ++_r )
+            {
+                os << "<e i=\"" << _r << "\">" << random.word() << "</e>\n";
+            }
+            os << "</root>\n";
+        }
+
+        static void attrs( std::ostream& os, Random& random, size_t records )
+        {
+            os << "<set>\n";
+            for ( size_t _r(0); _r < records; ++_r )
+            {
+                os << "<rec";
+                for ( size_t _a(1); _a <= 12; ++_a )
+                {
+                    os << " a" << _a << "=\"" << random.word();
+                    os << random.below( 1000 ) << "\"";
+                }
+                os << "/>\n";
+            }
+            os << "</set>\n";
+        }
+
+        static void text( std::ostream& os, Random& random, size_t records )
+        {
+            static char const* const    _langs[] = { "en", "de", "fr" };
+            os << "<doc>\n";
+            for ( size_t _r(0); _r < records; ++_r )
+            {
+                os << "<para lang=\"" << _langs[random.below( 3 )] << "\"";
+                os << " title=\"" << random.words( 3 ) << "\">";
+                size_t const    _words(60 + random.below( 60 ));
+                os << random.words( _words ) << "</para>\n";
+            }
+            os << "</doc>\n";
+        }
+    };
+
+    /**
+     * Tally.  Output target that only counts what it is given (rows,
+     * items, bytes), so that evaluation is timed without formatting; it
+     * records the rows too when given somewhere to keep them, for the
+     * output benchmarks to replay.
+     */
+    struct Tally
+    {
+        struct Row
+        {
+            std::string                 label_;
+            std::vector<std::string>    items_;
+            std::vector<bool>           nulls_;
+        };
+
+        explicit
+        Tally(std::vector<Row>* keep = nullptr)
+        : rows_(0)
+        , items_(0)
+        , bytes_(0)
+        , keep_(keep)
+        {}
+
+        void label( std::string const& label )
+        {
+            ++rows_;
+            if ( keep_ )
+            {
+                keep_->push_back( Row{ label, {}, {} } );
+            }
+        }
+
+        void item( Utility::StringView const& item, bool null = false )
+        {
+            ++items_;
+            bytes_ += item.size();
+            if ( keep_ )
+            {
+                keep_->back().items_.push_back( item.str() );
+                keep_->back().nulls_.push_back( null );
+            }
+        }
+
+        size_t              rows_;
+        size_t              items_;
+        size_t              bytes_;
+        std::vector<Row>*   keep_;
+    };
+
+    /**
+     * NullBuffer.  Stream buffer that counts what is written to it and
+     * throws it away, through a buffer of the usual size so that the
+     * formatting code takes the paths it takes with a real stream.
+     */
+    class NullBuffer
+    : public std::streambuf
+    {
+    public:
+        NullBuffer()
+        : buffer_(64 * 1024)
+        , bytes_(0)
+        {
+            setp( buffer_.data(), buffer_.data() + buffer_.size() );
+        }
+
+        size_t bytes() const { return bytes_ + (pptr() - pbase()); }
+
+    protected:
+        int_type overflow( int_type c ) override
+        {
+            bytes_ += pptr() - pbase();
+            setp( buffer_.data(), buffer_.data() + buffer_.size() );
+            if ( !traits_type::eq_int_type( c, traits_type::eof() ) )
+            {
+                *pptr() = traits_type::to_char_type( c );
+                pbump( 1 );
+            }
+            return traits_type::not_eof( c );
+        }
+
+    private:
+        std::vector<char>   buffer_;
+        size_t              bytes_;
+    };
+
+    // error policy of the checks: a failure is in the mapper's result
+    struct Quiet
+    {
+        void on_error( std::string const& ) const
+        {}
+    };
+
+    /**
+     * ArrowTable.  An Arrow IPC stream as ArrowOutput writes it (utf8
+     * columns, plain or dictionary encoded, little-endian) read back, for
+     * the checks: the column names, and the rows as Tally keeps them (the
+     * first column as the label).  Just enough of the FlatBuffers wire
+     * format to walk the messages; anything else leaves it not ok().
+     */
+    class ArrowTable
+    {
+    public:
+        explicit
+        ArrowTable(std::string const& stream)
+        : data_(stream)
+        , names_()
+        , dictionary_()
+        , values_()
+        , rows_()
+        , ok_(false)
+        {
+            try
+            {
+                ok_ = read();
+            }
+            catch ( std::out_of_range const& )
+            {
+                ok_ = false;
+            }
+        }
+
+        bool ok() const { return ok_; }
+        std::vector<std::string> const& names() const { return names_; }
+        std::vector<Tally::Row> const& rows() const { return rows_; }
+
+    private:
+        enum Header { SchemaMessage = 1, DictionaryBatch = 2, RecordBatch = 3 };
+
+        bool read()
+        {
+            size_t      _at(0);
+            for ( ;; )
+            {
+                size_t const    _length(get( _at + 4, 4 ));
+                if ( get( _at, 4 ) != 0xFFFFFFFF )
+                {
+                    return false;
+                }
+                if ( _length == 0 )
+                {
+                    return _at + 8 == data_.size() and !names_.empty();
+                }
+                size_t const    _meta(_at + 8);
+                size_t const    _message(target( _meta ));
+                size_t const    _header(object( _message, 2 ));
+                size_t const    _body(_meta + _length);
+                switch ( scalar( _message, 1, 1 ) )
+                {
+                case SchemaMessage:  schema( _header ); break;
+                case DictionaryBatch:
+                    {
+                        std::vector<std::vector<std::string> >  _columns;
+                        std::vector<std::vector<bool> >         _nulls;
+                        if ( !batch( object( _header, 1 ), _body, true, _columns, _nulls ) or _columns.size() != 1 )
+                        {
+                            return false;
+                        }
+                        values_[scalar( _header, 0, 8 )] = _columns.front();
+                    }
+                    break;
+                case RecordBatch:
+                    {
+                        std::vector<std::vector<std::string> >  _columns;
+                        std::vector<std::vector<bool> >         _nulls;
+                        if ( !batch( _header, _body, false, _columns, _nulls ) or _columns.size() != names_.size() )
+                        {
+                            return false;
+                        }
+                        for ( size_t _r(0); _r < _columns.front().size(); ++_r )
+                        {
+                            rows_.push_back( Tally::Row{ _columns[0][_r], {}, {} } );
+                            for ( size_t _c(1); _c < _columns.size(); ++_c )
+                            {
+                                rows_.back().items_.push_back( _columns[_c][_r] );
+                                rows_.back().nulls_.push_back( _nulls[_c][_r] );
+                            }
+                        }
+                    }
+                    break;
+                default: return false;
+                }
+                _at = _body + scalar( _message, 3, 8 );
+            }
+        }
+
+        void schema( size_t schema )
+        {
+            size_t const    _fields(object( schema, 1 ));
+            for ( size_t _f(0); _f < get( _fields, 4 ); ++_f )
+            {
+                size_t const    _field(target( _fields + 4 + 4 * _f ));
+                size_t const    _name(object( _field, 0 ));
+                names_.push_back( data_.substr( _name + 4, get( _name, 4 ) ) );
+                dictionary_.push_back( field( _field, 4 ) ? int64_t(scalar( object( _field, 4 ), 0, 8 )) : -1 );
+            }
+        }
+
+        // the columns of a RecordBatch (of a dictionary's values, or of
+        // the table's, with dictionary indices resolved)
+        bool batch( size_t batch, size_t body, bool values, std::vector<std::vector<std::string> >& columns,
+            std::vector<std::vector<bool> >& nulls ) const
+        {
+            size_t const    _rows(scalar( batch, 0, 8 ));
+            size_t const    _nodes(object( batch, 1 ));
+            size_t const    _buffers(object( batch, 2 ));
+            size_t          _buffer(0);
+            auto            _next([&]( size_t& length ) -> size_t
+            {
+                size_t const    _entry(_buffers + 4 + 16 * _buffer++);
+                length = get( _entry + 8, 8 );
+                return body + get( _entry, 8 );
+            });
+            for ( size_t _c(0); _c < get( _nodes, 4 ); ++_c )
+            {
+                if ( get( _nodes + 4 + 16 * _c, 8 ) != _rows )
+                {
+                    return false;
+                }
+                size_t          _length;
+                size_t const    _valid(_next( _length ));
+                bool const      _nullable(_length > 0);
+                columns.push_back( std::vector<std::string>(_rows) );
+                nulls.push_back( std::vector<bool>(_rows, false) );
+                int64_t const   _dictionary(values ? -1 : dictionary_.at( _c ));
+                size_t const    _offsets(_next( _length ));
+                size_t const    _data(_dictionary < 0 ? _next( _length ) : 0);
+                for ( size_t _r(0); _r < _rows; ++_r )
+                {
+                    nulls.back()[_r] = _nullable and !(get( _valid + _r / 8, 1 ) & (1 << (_r % 8)));
+                    if ( nulls.back()[_r] )
+                    {
+                        continue;
+                    }
+                    if ( _dictionary < 0 )
+                    {
+                        size_t const    _begin(get( _offsets + 4 * _r, 4 ));
+                        columns.back()[_r] = data_.substr( _data + _begin, get( _offsets + 4 * _r + 4, 4 ) - _begin );
+                    }
+                    else
+                    {
+                        columns.back()[_r] = values_.at( _dictionary ).at( get( _offsets + 4 * _r, 4 ) );
+                    }
+                }
+            }
+            return true;
+        }
+
+        // the little-endian integer of 'size' bytes at 'at'
+        uint64_t get( size_t at, size_t size ) const
+        {
+            if ( at + size > data_.size() )
+            {
+                throw std::out_of_range("ArrowTable: past the end");
+            }
+            uint64_t    _value(0);
+            for ( size_t _b(size); _b-- > 0; )
+            {
+                _value = _value << 8 | static_cast<uint8_t>(data_[at + _b]);
+            }
+            return _value;
+        }
+
+        // position of field 'id' of the table at 'table', or 0 if absent
+        size_t field( size_t table, size_t id ) const
+        {
+            size_t const    _vtable(table - int32_t(get( table, 4 )));
+            if ( 4 + 2 * id >= get( _vtable, 2 ) )
+            {
+                return 0;
+            }
+            size_t const    _offset(get( _vtable + 4 + 2 * id, 2 ));
+            return _offset ? table + _offset : 0;
+        }
+
+        uint64_t scalar( size_t table, size_t id, size_t size ) const
+        {
+            size_t const    _field(field( table, id ));
+            return _field ? get( _field, size ) : 0;
+        }
+
+        // the target of the offset at 'at'
+        size_t target( size_t at ) const
+        {
+            return at + get( at, 4 );
+        }
+
+        // the target of offset field 'id'
+        size_t object( size_t table, size_t id ) const
+        {
+            size_t const    _field(field( table, id ));
+            if ( !_field )
+            {
+                throw std::out_of_range("ArrowTable: missing field");
+            }
+            return target( _field );
+        }
+
+        std::string const                           data_;
+        std::vector<std::string>                    names_;
+        std::vector<int64_t>                        dictionary_;    // id per column, or -1
+        std::map<int64_t, std::vector<std::string> > values_;       // by dictionary id
+        std::vector<Tally::Row>                     rows_;
+        bool                                        ok_;
+    };
+
+} // namespace Bench
+
+namespace XmlSys
+{
+    template<>
+    struct TargetMethods<Bench::Tally>
+    {
+        static void label( Bench::Tally& tally, std::string const& label )
+        {
+            tally.label( label );
+        }
+
+        static void item( Bench::Tally& tally, Utility::StringView const& item )
+        {
+            tally.item( item );
+        }
+
+        static void no_data( Bench::Tally& tally )
+        {
+            tally.item( Utility::StringView(), true );
+        }
+
+        static void end( Bench::Tally& )
+        {}
+    };
+
+} // namespace XmlSys
+
+    /**
+     * XpBench.  Benchmarks of the stages of an xpmatch run, each timed on
+     * its own over a generated corpus of each Shape held in memory (so that
+     * file I/O is left out): pugixml parsing (in place, as with -m, then
+     * followed by the deep copy parsing once made, and again with the
+     * options of --lazy), XpathAgent evaluation in grep mode (AgentMapper)
+     * and in table mode (AgentSetMapper), of the column paths alone (walked
+     * where simple, then all by the XPath engine), and the formatting of
+     * each output class of LineOutput.h, replaying the grep hits
+     * (PrefixedOutput) or table rows (the others, and QuotedOutput again
+     * with quotes in every value) into a stream that discards them; then
+     * parsing and grep mode together on 1, 8 and 32 threads (--threads),
+     * once with pugixml allocating through malloc and once through
+     * PageCache's per-thread pools.  Each benchmark is run --reps times;
+     * results are JSON Lines on STDOUT (or --out), one object per benchmark
+     * and corpus, and --compare sets the best times of two result files
+     * side by side.  With --check, it runs instead a few checks of the
+     * results of cases known to have gone wrong, of the streaming scan
+     * against the DOM, of SetMatcher against each column's XpathAgent, of
+     * deferred decoding against the parse's, and of the Arrow output (read
+     * back by ArrowTable) against the TSV output.
+     */
+    class XpBench
+    {
+    public:
+        XpBench() = default;
+        ~XpBench() = default;
+
+        // exit status: 2 if --compare found a regression, or a check failed
+        int run( int ac, char *av[] )
+        {
+            if ( !parse( ac, av ) )
+            {
+                return 0;
+            }
+            if ( OPTION_PRESENT(vm_, "check") )
+            {
+                return check() ? 0 : 2;
+            }
+            if ( OPTION_PRESENT(vm_, "compare") )
+            {
+                return compare() ? 0 : 2;
+            }
+            std::ofstream       _file;
+            if ( !outfile_.empty() )
+            {
+                _file.open( outfile_.c_str() );
+                if ( !_file )
+                {
+                    std::cerr << "Problem with output file [" << outfile_ << "]!" << std::endl;
+                    return 1;
+                }
+            }
+            std::ostream&       _os(outfile_.empty() ? std::cout : _file);
+            ::mkdir( corpus_.c_str(), 0777 );
+            if ( OPTION_ABSENT(vm_, "generate") )
+            {
+                _os << "{\"bench\":\"meta\",\"scale\":" << scale_ << ",\"reps\":" << reps_ << "}\n";
+            }
+            for ( auto const& shape : Bench::Shape::all() )
+            {
+                if ( selected( shape.name_ ) and generate( shape ) and OPTION_ABSENT(vm_, "generate") )
+                {
+                    measure( shape, _os );
+                }
+            }
+            return 0;
+        }
+
+    private:
+        XpBench(XpBench const&) = delete;
+        XpBench& operator= ( XpBench const& ) = delete;
+
+        typedef Bench::Tally::Row   Row;
+        typedef std::vector<double> Times;  // ms
+
+        po::variables_map           vm_;
+        std::string                 corpus_;
+        unsigned                    scale_;
+        unsigned                    reps_;
+        std::vector<std::string>    only_;
+        std::string                 outfile_;
+        std::vector<std::string>    compare_;
+        double                      threshold_;
+        std::vector<unsigned>       threads_;
+
+        bool parse( int ac, char *av[] )
+        {
+            po::options_description     _options("Options");
+            _options.add_options()
+                ( "help,h", "show options" )
+                ( "corpus", po::value<std::string>(&corpus_)->default_value( "bench-corpus" ), "directory of the generated corpus (made if need be)" )
+                ( "scale", po::value<unsigned>(&scale_)->default_value( 1 ), "corpus size factor" )
+                ( "generate", "generate the corpus only" )
+                ( "reps", po::value<unsigned>(&reps_)->default_value( 5 ), "runs of each benchmark" )
+                ( "only", po::value<std::vector<std::string> >(&only_), "run only this corpus shape (repeatable): small, huge, deep, wide, attrs, text" )
+                ( "out,O", po::value<std::string>(&outfile_), "write results to file instead of STDOUT" )
+                ( "compare", po::value<std::vector<std::string> >(&compare_)->multitoken(), "compare two result files: old new" )
+                ( "threshold", po::value<double>(&threshold_)->default_value( 10 ), "slowdown (%) reported as a regression by --compare" )
+                ( "threads", po::value<std::vector<unsigned> >(&threads_)->multitoken(), "thread counts of the allocator benchmarks (default 1 8 32)" )
+                ( "check", "run the checks of results instead" )
+                ;
+            po::store( po::parse_command_line( ac, av, _options ), vm_ );
+            if ( OPTION_PRESENT(vm_, "help") )
+            {
+                std::cerr
+                    << "\nUsage: \n\t"
+                    << av[0] << " options\n"
+                    << _options
+                    << std::endl;
+                return false;
+            }
+            po::notify( vm_ );
+            if ( OPTION_PRESENT(vm_, "compare") and compare_.size() != 2 )
+            {
+                throw std::runtime_error("--compare takes two result files");
+            }
+            reps_ = std::max( reps_, 1u );
+            scale_ = std::max( scale_, 1u );
+            if ( threads_.empty() )
+            {
+                threads_ = { 1, 8, 32 };
+            }
+            return true;
+        }
+
+        bool selected( std::string const& name ) const
+        {
+            return only_.empty() or std::find( only_.begin(), only_.end(), name ) != only_.end();
+        }
+
+        std::string const path( Bench::Shape const& shape, std::string const& file = "" ) const
+        {
+            return corpus_ + '/' + shape.name_ + (file.empty() ? "" : '/' + file);
+        }
+
+        static std::string const file_name( size_t index )
+        {
+            char    _name[32];
+            std::snprintf( _name, sizeof _name, "f%05zu.xml", index );
+            return _name;
+        }
+
+        size_t files( Bench::Shape const& shape ) const
+        {
+            return shape.huge_ ? shape.files_ : shape.files_ * scale_;
+        }
+
+        /**
+         * Writes the corpus of a shape under <corpus>/<shape>, with a list
+         * of its files (for xpmatch -l), unless it is there already at this
+         * scale, as recorded in a STAMP file written last.
+         */
+        bool generate( Bench::Shape const& shape ) const
+        {
+            std::string const   _stamp("xpbench corpus 1 scale " + std::to_string( scale_ ));
+            std::string         _line;
+            std::ifstream       _in(path( shape, "STAMP" ).c_str());
+            if ( std::getline( _in, _line ) and _line == _stamp )
+            {
+                return true;
+            }
+            ::mkdir( path( shape ).c_str(), 0777 );
+            Bench::Random       _random(0x5eed0000ULL + shape.files_ * 131 + shape.records_);
+            size_t const        _records(shape.huge_ ? shape.records_ * scale_ : shape.records_);
+            std::ofstream       _list(path( shape, "list" ).c_str());
+            for ( size_t _f(0); _f < files( shape ); ++_f )
+            {
+                std::ofstream   _os(path( shape, file_name( _f ) ).c_str());
+                shape.write_( _os, _random, _records );
+                _list << file_name( _f ) << '\n';
+                if ( !_os )
+                {
+                    std::cerr << "Problem writing corpus file [" << path( shape, file_name( _f ) ) << "]!" << std::endl;
+                    return false;
+                }
+            }
+            std::ofstream       _out(path( shape, "STAMP" ).c_str());
+            _out << _stamp << '\n';
+            return true;
+        }
+
+        // best of the runs of body(), which returns what it counted
+        template<typename Prepare, typename Body>
+        Times time( Prepare prepare, Body body, size_t& count ) const
+        {
+            Times       _times;
+            for ( unsigned _r(0); _r < reps_; ++_r )
+            {
+                prepare();
+                auto const  _start(std::chrono::steady_clock::now());
+                count = body();
+                auto const  _stop(std::chrono::steady_clock::now());
+                _times.push_back( std::chrono::duration<double, std::milli>(_stop - _start).count() );
+            }
+            std::sort( _times.begin(), _times.end() );
+            return _times;
+        }
+
+        template<typename Body>
+        Times time( Body body, size_t& count ) const
+        {
+            return time( [](){}, body, count );
+        }
+
+        /**
+         * Each check compares what a case yields, as rows written out by
+         * rows(), with what it should; all are run, and reported on.
+         */
+        bool check() const
+        {
+            size_t          _failed(0);
+            auto            _expect([&]( std::string const& name, std::string const& result, std::string const& expected )
+            {
+                bool const  _ok(result == expected);
+                std::cout << "check " << name << ": " << (_ok ? "ok" : "FAILED") << std::endl;
+                if ( !_ok )
+                {
+                    std::cout << "    got      [" << result << "]\n    expected [" << expected << "]" << std::endl;
+                    ++_failed;
+                }
+            });
+
+            // --early: text cut off by the end of the input completes no value
+            XmlSys::XpathAgent const        _title("/feed/title");
+            std::vector<std::string> const  _spec({ "Name rec/name", "Id rec/@id" });
+            XmlSys::AgentSet const          _columns(_spec.begin(), _spec.end());
+            XmlSys::StreamPlan const        _grep(XmlSys::StreamPlan(_title).early( true ));
+            XmlSys::StreamPlan const        _table(XmlSys::StreamPlan(_columns, "/feed").early( true ));
+            _expect( "early/complete", streamed( _grep, "<feed><title>abc</title><rest>" ), "doc:abc" );
+            _expect( "early/truncated-text", streamed( _grep, "<feed><title>abc" ), "failed" );
+            _expect( "early/truncated-row", streamed( _table, "<feed><rec id=\"9\"><name>broken\n" ), "failed" );
+            _expect( "early/truncated-cdata", streamed( _grep, "<feed><title><![CDATA[abc" ), "failed" );
+
+            // --early: documents that are not UTF-8 are read by the DOM
+            std::string const   _record("<feed><title>a &amp; b</title><rec id=\"9\"><name>n</name></rec></feed>");
+            _expect( "early/utf-16le", streamed( _grep, utf16( _record, true ) ), "doc:a & b" );
+            _expect( "early/utf-16be", streamed( _table, utf16( _record, false ) ), "doc:n|9" );
+            _expect( "early/latin-1", streamed( _table, "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?>" + _record ), "doc:n|9" );
+
+            // --stream: the rows the DOM yields, with the text and attribute
+            // values decoded alike, and the same elements matched by each step
+            auto            _same([&]( std::string const& name, std::string const& initial,
+                std::vector<std::string> const& spec, std::string const& xml )
+            {
+                XmlSys::AgentSet const  _set(spec.begin(), spec.end());
+                _expect( "stream/" + name, streamed( XmlSys::StreamPlan(_set, initial), xml ), mapped( _set, initial, xml ) );
+            });
+            _same( "entities", "/feed/rec", { "Name name", "Note @note" },
+                "<feed><rec note=\"&lt;&amp;&gt;&quot;&apos;&#65;&#x42;&#233;&#x20AC;\">"
+                "<name>a &amp; b &lt;c&gt; &#x41;&#66;&#x00e9;&#8364; &unknown;</name></rec></feed>" );
+            _same( "crlf", "/feed/rec", { "Text text", "Note @note" },
+                "<feed>\r\n<rec note=\"a\r\nb\rc\">\r\n<text>line 1\r\nline 2\rline 3\r\n</text></rec></feed>" );
+            _same( "cdata", "/feed/rec", { "Raw raw", "Mixed mixed" },
+                "<feed><rec><raw><![CDATA[<b> &amp; \r\n]]></raw><mixed>\n  <![CDATA[x]]>y</mixed></rec></feed>" );
+            _same( "tabs", "/feed/rec", { "Tab @tab", "Line @line", "Id @id" },
+                "<feed><rec tab=\"a\tb&#9;c\" line=\"a\nb&#10;c&#13;\" id=' 7 '/></feed>" );
+            std::string const               _tree("<doc><a><b><c>1</c></b><d><x><e>2</e></x></d></a>"
+                "<c k=\"v\">3</c><c k=\"w\">4</c><d><e>5</e><d><e>6</e></d></d><f/></doc>");
+            _same( "descendants", "", { "Any .//c", "Named descendant-or-self::node()/c", "Below descendant::e",
+                "Nested d//e", "Star */b/c", "Last .//d/d/e", "Missing .//g", "Empty f" }, _tree );
+            _same( "predicates", "", { "Key c[@k]", "Value c[@k='w']", "Deep .//c[@k='v']/@k", "None c[@k='x']" }, _tree );
+            _same( "self", "//d", { "Self self::node()", "Dot .", "Named self::d/e", "Child e" }, _tree );
+            _same( "contexts", "//c[@k]", { "Text .", "Key @k" }, _tree );
+            _same( "nested", "//rec", { "N @n", "Value v" },
+                "<feed><rec n=\"1\"><rec n=\"2\"><v>b</v></rec><v>a</v></rec><rec n=\"3\"/></feed>" );
+
+            // table mode: SetMatcher's walk (or the XpathAgent it falls back
+            // to) yields each column's own XpathAgent value, context by context
+            auto            _walks([&]( std::string const& name, std::string const& initial,
+                std::vector<std::string> const& spec, std::string const& xml )
+            {
+                XmlSys::AgentSet const  _set(spec.begin(), spec.end());
+                _expect( "set/" + name, mapped( _set, initial, xml ), evaluated( spec, initial, xml ) );
+            });
+            std::string const   _records("<feed><rec id=\"1\"><a><b k=\"x\"><c>1</c></b><b k=\"y\"><c>2</c><d>3</d></b></a>"
+                "<c>4</c><c k=\"v\">5</c><e>6</e></rec><rec id=\"2\"><a><b><d>7</d></b></a><e>8</e><e>9</e></rec>"
+                "<rec id=\"3\"/><rec><a><b k=\"y\"><c>10</c></b></a><c>11</c></rec></feed>");
+            _walks( "child", "//rec", { "Id @id", "C a/b/c", "K a/b/@k", "D a/b/d", "Star a/*/c", "E e", "None a/g" }, _records );
+            _walks( "descendant", "//rec", { "Any .//c", "Key .//b/@k", "Below a//d", "Global //e" }, _records );
+            _walks( "predicates", "//rec", { "Key c[@k]", "Value a/b[@k='y']/c", "Second e[2]", "Last a/b[last()]/c" }, _records );
+            _walks( "unions", "//rec", { "Either d | e", "Nested a/b/d | c", "Keys a/b/@k | @id" }, _records );
+            _walks( "parent", "//rec/a/b", { "Up ../../@id", "Sibling ../b/c", "Self ." , "Key @k" }, _records );
+            _walks( "document", "", { "First rec/@id", "Deep rec/a/b/c", "Any .//d", "Third rec[3]/@id" }, _records );
+
+            // --lazy: values decoded on extraction, walked or not, as the
+            // parse would have decoded them
+            auto            _lazy([&]( std::string const& name, std::vector<std::string> const& spec, std::string const& xml )
+            {
+                XmlSys::AgentSet const  _set(spec.begin(), spec.end());
+                std::string const       _eager(mapped( _set, "//rec", xml ));
+                XmlSys::XpathAgent::deferred() = true;
+                std::string const       _deferred(mapped( _set, "//rec", xml ));
+                XmlSys::XpathAgent::deferred() = false;
+                _expect( "lazy/" + name, _deferred, _eager );
+            });
+            std::vector<std::string> const  _values({ "Text text", "Note @note", "Deep .//text", "Global //rec/text/@note",
+                "Either cdata | text" });
+            _lazy( "entities", _values, "<feed><rec note=\"&lt;&amp;&gt;&quot;&apos;&#65;&#x42;&#233;&#x20AC;\">"
+                "<text note=\"&#x41;&amp;\">a &amp; b &lt;c&gt; &#x41;&#66;&#x00e9;&#8364; &unknown;</text></rec>"
+                "<rec><text>&amp;amp;&#38;</text></rec></feed>" );
+            _lazy( "crlf", _values, "<feed>\r\n<rec>\r\n<text note=\"a\r\nb\">line 1\r\nline 2\rline 3\r\n</text></rec>"
+                "<rec><cdata><![CDATA[x\r\ny\r]]></cdata></rec></feed>" );
+            _lazy( "attributes", _values, "<feed><rec note=\"a\tb&#9;c\nd&#10;e\r\nf\rg&#13;\"><text note=\"\t \">"
+                "t</text></rec></feed>" );
+
+            // -q: quotes doubled, wherever they fall in the 16-byte blocks
+            auto            _csv([]( std::string const& value ) -> std::string
+            {
+                std::ostringstream  _os;
+                Utility::CsvText::quoted( _os, Utility::StringView(value.data(), value.size()) );
+                return _os.str();
+            });
+            _expect( "quoted/plain", _csv( "plain value, no quotes at all" ), "\"plain value, no quotes at all\"" );
+            _expect( "quoted/quotes", _csv( "\"a\"\"b, 15 bytes on\" then 16 more \"\"\"" ),
+                "\"\"\"a\"\"\"\"b, 15 bytes on\"\" then 16 more \"\"\"\"\"\"\"" );
+            _expect( "quoted/lines", _csv( "line 1\r\nline 2\n" ), "\"line 1\r\nline 2\n\"" );
+
+            // --json: control characters, quotes and backslashes escaped,
+            // wherever they fall in the 16-byte blocks; other text as it is
+            auto            _json([]( std::string const& value ) -> std::string
+            {
+                std::ostringstream  _os;
+                Utility::JsonText::quoted( _os, Utility::StringView(value.data(), value.size()) );
+                return _os.str();
+            });
+            _expect( "json/empty", _json( "" ), "\"\"" );
+            _expect( "json/controls", _json( std::string("\0\x01\b\t\n\x0b\f\r\x1f end", 13) ),
+                "\"\\u0000\\u0001\\b\\t\\n\\u000b\\f\\r\\u001f end\"" );
+            _expect( "json/quotes", _json( "\"a\\b, 15 bytes on\" then 16 more \\\"\\" ),
+                "\"\\\"a\\\\b, 15 bytes on\\\" then 16 more \\\\\\\"\\\\\"" );
+            _expect( "json/utf-8", _json( "caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80 \x7F, past 16 bytes" ),
+                "\"caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80 \x7F, past 16 bytes\"" );
+            {
+                std::vector<std::string> const  _columns({ "Name name", "Empty empty", "Missing missing", "Odd\"key\\ @odd" });
+                XmlSys::AgentSet const          _set(_columns.begin(), _columns.end());
+                std::ostringstream              _os;
+                Utility::JsonOutput             _output(_os);
+                XmlSys::AgentSetMapper<Utility::JsonOutput, Bench::Quiet>   _mapper(_set, _output);
+                std::istringstream              _in("<rec odd=\"&#9;\\\"><name>a\tb \"c\"</name><empty/></rec>");
+                _set.headers( _output ); // keys, as xpmatch --json sets them
+                _mapper( _in, "dir\\doc\".xml" );
+                _expect( "json/row", _os.str(), "{\"Source\":\"dir\\\\doc\\\".xml\",\"Name\":\"a\\tb \\\"c\\\"\","
+                    "\"Empty\":\"\",\"Missing\":null,\"Odd\\\"key\\\\\":\"\\t\\\\\"}\n" );
+            }
+
+            // --arrow: the table the TSV output holds, read back (in two
+            // batches, with dictionaries for the repetitive column)
+            {
+                std::vector<std::string> const  _columns({ "Kind kind", "Name name", "Empty empty", "Odd odd" });
+                XmlSys::AgentSet const          _set(_columns.begin(), _columns.end());
+                std::ostringstream              _tsv;
+                std::ostringstream              _arrow;
+                std::vector<Row>                _rows;
+                {
+                    Utility::DelimitedOutput    _delimited(_tsv);
+                    Utility::ArrowOutput        _output(_arrow, 8);
+                    Bench::Tally                _tally(&_rows);
+                    _set.headers( _output ); // names, as xpmatch --arrow sets them
+                    for ( size_t _d(0); _d < 10; ++_d )
+                    {
+                        std::string const   _xml("<rec><kind>" + std::string(_d % 3 ? "plain" : "caf\xC3\xA9")
+                            + "</kind><name>name " + std::to_string( _d ) + "</name><empty/>"
+                            + (_d % 2 ? "<odd>" + std::string(_d, 'x') + "</odd>" : "") + "</rec>");
+                        std::string const   _label("doc" + std::to_string( _d ));
+                        std::istringstream  _in(_xml);
+                        XmlSys::AgentSetMapper<Utility::DelimitedOutput, Bench::Quiet>(_set, _delimited)( _in, _label );
+                        _in.clear();
+                        _in.seekg( 0 );
+                        XmlSys::AgentSetMapper<Utility::ArrowOutput, Bench::Quiet>(_set, _output)( _in, _label );
+                        _in.clear();
+                        _in.seekg( 0 );
+                        XmlSys::AgentSetMapper<Bench::Tally, Bench::Quiet>(_set, _tally)( _in, _label );
+                    }
+                } // the end of the Arrow stream
+                Bench::ArrowTable const         _table(_arrow.str());
+                std::string                     _delimited;
+                for ( auto const& row : _table.rows() )
+                {
+                    _delimited += row.label_;
+                    for ( auto const& item : row.items_ )
+                    {
+                        _delimited += '\t' + item; // a null as a blank
+                    }
+                    _delimited += '\n';
+                }
+                std::string const               _text(_tsv.str());
+                _expect( "arrow/read", _table.ok() ? "ok" : "unreadable", "ok" );
+                _expect( "arrow/columns", std::to_string( _table.names().size() ), std::to_string( _columns.size() + 1 ) );
+                _expect( "arrow/rows", std::to_string( _table.rows().size() ),
+                    std::to_string( std::count( _text.begin(), _text.end(), '\n' ) ) );
+                _expect( "arrow/values", _delimited, _text );
+                _expect( "arrow/nulls", rows( _table.rows() ), rows( _rows ) );
+            }
+
+            // simple paths, walked, match the nodes the XPath engine does
+            for ( auto const& shape : Bench::Shape::all() )
+            {
+                std::ostringstream      _xml;
+                Bench::Random           _random(0x5eed0000ULL + shape.files_);
+                shape.write_( _xml, _random, std::min<size_t>( shape.records_, 20 ) );
+                std::string             _text(_xml.str());
+                XmlSys::XmlDoc const    _doc(&_text[0], _text.size());
+                std::string             _walked;
+                std::string             _engine;
+                auto const              _paths(columns( shape, false ));
+                auto const              _queries(columns( shape, true ));
+                for ( size_t _c(0); _c < _paths.size(); ++_c )
+                {
+                    std::vector<XmlSys::Xpath_Node>     _nodes;
+                    std::vector<XmlSys::Xpath_Node>     _found;
+                    each_context( shape, _doc, [&]( XmlSys::Xml_Node const& context ) -> void
+                    {
+                        auto        _walk([&]( XmlSys::Xpath_Node const& node ) -> void { _nodes.push_back( node ); });
+                        auto        _query([&]( XmlSys::Xpath_Node const& node ) -> void { _found.push_back( node ); });
+                        _paths[_c].apply_raw( context, _walk );
+                        _queries[_c].apply_raw( context, _query );
+                    } );
+                    std::string const   _column(_paths[_c].xpath() + '=' + std::to_string( _nodes.size() ) + ' ');
+                    _walked += _column;
+                    _engine += _nodes == _found ? _column : _paths[_c].xpath() + "=differs ";
+                }
+                _expect( std::string("simple-path/") + shape.name_, _walked, _engine );
+            }
+
+            std::cout << "checks: " << _failed << " failed" << std::endl;
+            return _failed == 0;
+        }
+
+        // the column paths of a shape: simple ones (see XpathAgent::
+        // simplePath) are walked, unless 'engine' puts all of them through
+        // the XPath engine, by a leading step that keeps them equivalent
+        static std::vector<XmlSys::XpathAgent> const columns( Bench::Shape const& shape, bool engine )
+        {
+            std::vector<XmlSys::XpathAgent>     _agents;
+            for ( auto const& spec : shape.spec_ )
+            {
+                std::string const   _path(spec.substr( spec.find( ' ' ) + 1 ));
+                _agents.push_back( XmlSys::XpathAgent((engine ? "self::node()/" : "") + _path) );
+            }
+            return _agents;
+        }
+
+        // handler( node ) for each context node of the shape in doc
+        template<typename Handler>
+        static void each_context( Bench::Shape const& shape, XmlSys::XmlDoc const& doc, Handler handler )
+        {
+            XmlSys::XpathAgent const    _context(shape.context_);
+            doc.process_root( [&]( XmlSys::Xml_Node const& root ) -> void { _context.apply( root, handler ); } );
+        }
+
+        // the rows of the streaming plan over 'xml', or "failed"
+        static std::string streamed( XmlSys::StreamPlan const& plan, std::string const& xml )
+        {
+            std::vector<Row>        _rows;
+            Bench::Tally            _tally(&_rows);
+            std::istringstream      _in(xml);
+            if ( !XmlSys::StreamSetMapper<Bench::Tally, Bench::Quiet>(plan, _tally)( _in, "doc" ) )
+            {
+                return "failed";
+            }
+            return rows( _rows );
+        }
+
+        // the rows of AgentSetMapper (the DOM) over 'xml', or "failed"
+        static std::string mapped( XmlSys::AgentSet const& agents, std::string const& initial, std::string const& xml )
+        {
+            std::vector<Row>        _rows;
+            Bench::Tally            _tally(&_rows);
+            std::istringstream      _in(xml);
+            XmlSys::AgentSetMapper<Bench::Tally, Bench::Quiet> const    _mapper(agents, _tally);
+            if ( !(initial.empty() ? _mapper( _in, "doc" ) : _mapper( _in, "doc", XmlSys::XpathAgent(initial) )) )
+            {
+                return "failed";
+            }
+            return rows( _rows );
+        }
+
+        // the rows of each column's own XpathAgent over 'xml', as mapped()
+        // gives them: a row per context node, the first value of each column
+        static std::string evaluated( std::vector<std::string> const& spec, std::string const& initial, std::string xml )
+        {
+            std::vector<XmlSys::XpathAgent>     _agents;
+            for ( auto const& column : spec )
+            {
+                _agents.push_back( XmlSys::XpathAgent(column.substr( column.find( ' ' ) + 1 )) );
+            }
+            std::vector<Row>        _rows;
+            auto                    _row([&]( XmlSys::Xml_Node const& context ) -> void
+            {
+                _rows.push_back( Row{ "doc", {}, {} } );
+                for ( auto const& agent : _agents )
+                {
+                    std::string     _value;
+                    bool const      _found(agent( context, _value ));
+                    _rows.back().items_.push_back( _value );
+                    _rows.back().nulls_.push_back( !_found );
+                }
+            });
+            XmlSys::XmlDoc const    _doc(&xml[0], xml.size());
+            if ( initial.empty() )
+            {
+                _doc.process_root( _row );
+            }
+            else
+            {
+                _doc.apply( XmlSys::XpathAgent(initial), _row );
+            }
+            return rows( _rows );
+        }
+
+        // ASCII text as UTF-16 (little or big endian), with the byte order mark
+        static std::string utf16( std::string const& text, bool little )
+        {
+            std::string     _out(little ? "\xFF\xFE" : "\xFE\xFF");
+            for ( char c : text )
+            {
+                _out += little ? std::string(1, c) + '\0' : '\0' + std::string(1, c);
+            }
+            return _out;
+        }
+
+        // label:item|item..., a line per row (null items as ~)
+        static std::string rows( std::vector<Row> const& rows )
+        {
+            std::string     _out;
+            for ( auto const& row : rows )
+            {
+                _out += (_out.empty() ? "" : "\n") + row.label_ + ':';
+                for ( size_t _i(0); _i < row.items_.size(); ++_i )
+                {
+                    _out += (_i ? "|" : "") + (row.nulls_[_i] ? std::string("~") : row.items_[_i]);
+                }
+            }
+            return _out;
+        }
+
+        void measure( Bench::Shape const& shape, std::ostream& os ) const
+        {
+            // the corpus, in memory
+            std::vector<std::vector<char> >     _files;
+            std::vector<std::string>            _labels;
+            size_t                              _bytes(0);
+            for ( size_t _f(0); _f < files( shape ); ++_f )
+            {
+                _labels.push_back( file_name( _f ) );
+                std::ifstream   _in(path( shape, _labels.back() ).c_str(), std::ios::binary);
+                _files.push_back( std::vector<char>((std::istreambuf_iterator<char>(_in)), std::istreambuf_iterator<char>()) );
+                _bytes += _files.back().size();
+            }
+            std::cerr << shape.name_ << ": " << _files.size() << " files, " << _bytes << " bytes" << std::endl;
+
+            // parsing: in place, into a fresh copy for every run
+            std::vector<std::vector<char> >     _work;
+            size_t                              _count(0);
+            Times const     _parse(time( [&]() { _work = _files; }, [&]() -> size_t
+            {
+                for ( auto& file : _work )
+                {
+                    XmlSys::XmlDoc  _doc(file.data(), file.size());
+                }
+                return _work.size();
+            }, _count ));
+            report( os, "parse", shape, _files.size(), _bytes, _count, _parse );
+
+            // the same, then a deep copy of the tree: what parsing cost
+            // when DocBase parsed into a temporary and assigned it
+            Times const     _copy(time( [&]() { _work = _files; }, [&]() -> size_t
+            {
+                for ( auto& file : _work )
+                {
+                    XmlSys::XmlDoc const    _parsed(file.data(), file.size());
+                    XmlSys::XmlDoc const    _doc(_parsed);
+                }
+                return _work.size();
+            }, _count ));
+            report( os, "parse-copy", shape, _files.size(), _bytes, _count, _copy );
+
+            // the same, with decoding left to extraction (--lazy)
+            XmlSys::XpathAgent::deferred() = true;
+            Times const     _lazy(time( [&]() { _work = _files; }, [&]() -> size_t
+            {
+                for ( auto& file : _work )
+                {
+                    XmlSys::XmlDoc  _doc(file.data(), file.size());
+                }
+                return _work.size();
+            }, _count ));
+            XmlSys::XpathAgent::deferred() = false;
+            report( os, "parse-lazy", shape, _files.size(), _bytes, _count, _lazy );
+
+            // documents to evaluate, parsed once
+            _work = _files;
+            std::vector<XmlSys::XmlDoc>         _docs;
+            for ( auto& file : _work )
+            {
+                _docs.push_back( XmlSys::XmlDoc(file.data(), file.size()) );
+            }
+
+            // grep mode
+            XmlSys::XpathAgent const            _xpath(shape.xpath_);
+            Times const     _grep(time( [&]() -> size_t
+            {
+                Bench::Tally                        _tally;
+                XmlSys::AgentMapper<Bench::Tally>   _mapper(_xpath, _tally);
+                for ( size_t _d(0); _d < _docs.size(); ++_d )
+                {
+                    _mapper( _docs[_d], _labels[_d] );
+                }
+                return _tally.items_;
+            }, _count ));
+            report( os, "grep", shape, _docs.size(), _bytes, _count, _grep );
+
+            // table mode
+            XmlSys::AgentSet const              _agents(shape.spec_.begin(), shape.spec_.end());
+            XmlSys::XpathAgent const            _context(shape.context_);
+            Times const     _table(time( [&]() -> size_t
+            {
+                Bench::Tally                            _tally;
+                XmlSys::AgentSetMapper<Bench::Tally>    _mapper(_agents, _tally);
+                for ( size_t _d(0); _d < _docs.size(); ++_d )
+                {
+                    _mapper( _docs[_d], _labels[_d], _context );
+                }
+                return _tally.rows_;
+            }, _count ));
+            report( os, "table", shape, _docs.size(), _bytes, _count, _table );
+
+            // the columns one by one, from each context node: simple paths
+            // walked, then all through the XPath engine
+            for ( bool engine : { false, true } )
+            {
+                auto const      _paths(columns( shape, engine ));
+                Times const     _times(time( [&]() -> size_t
+                {
+                    size_t      _nodes(0);
+                    auto        _count([&]( XmlSys::Xpath_Node const& ) -> void { ++_nodes; });
+                    for ( auto const& doc : _docs )
+                    {
+                        each_context( shape, doc, [&]( XmlSys::Xml_Node const& context ) -> void
+                        {
+                            for ( auto const& path : _paths )
+                            {
+                                path.apply_raw( context, _count );
+                            }
+                        } );
+                    }
+                    return _nodes;
+                }, _count ));
+                report( os, engine ? "paths/xpath" : "paths/simple", shape, _docs.size(), _bytes, _count, _times );
+            }
+
+            // output: the rows found above, formatted
+            std::vector<Row>    _hits;
+            std::vector<Row>    _rows;
+            {
+                Bench::Tally                            _keepHits(&_hits);
+                XmlSys::AgentMapper<Bench::Tally>       _grepper(_xpath, _keepHits);
+                Bench::Tally                            _keepRows(&_rows);
+                XmlSys::AgentSetMapper<Bench::Tally>    _mapper(_agents, _keepRows);
+                for ( size_t _d(0); _d < _docs.size(); ++_d )
+                {
+                    _grepper( _docs[_d], _labels[_d] );
+                    _mapper( _docs[_d], _labels[_d], _context );
+                }
+            }
+            std::vector<std::string>    _headers;
+            auto            _header([&]( std::vector<std::string>::const_iterator begin, std::vector<std::string>::const_iterator end )
+            {
+                _headers.assign( begin, end );
+            });
+            _agents.headers( _header );
+
+            format( os, "prefixed", shape, _hits, [&]( std::ostream& out ) { return Utility::PrefixedOutput(out); } );
+            format( os, "delimited", shape, _rows, [&]( std::ostream& out ) { return Utility::DelimitedOutput(out); } );
+            format( os, "quoted", shape, _rows, [&]( std::ostream& out ) { return Utility::QuotedOutput(out); } );
+
+            // the same rows with quotes in every value, for the escapes
+            std::vector<Row>    _quotes(_rows);
+            for ( auto& row : _quotes )
+            {
+                for ( auto& item : row.items_ )
+                {
+                    item.insert( item.size() / 2, "\"" );
+                    item = "\"" + item + "\"";
+                }
+            }
+            format( os, "quoted-quotes", shape, _quotes, [&]( std::ostream& out ) { return Utility::QuotedOutput(out); } );
+            format( os, "json", shape, _rows, [&]( std::ostream& out ) -> Utility::JsonOutput
+            {
+                Utility::JsonOutput     _output(out);
+                _output( _headers.begin(), _headers.end() );
+                return _output;
+            } );
+
+            allocators( os, shape, _files, _bytes );
+        }
+
+        /**
+         * Parsing (a new document per file) and grep mode evaluation on
+         * several threads sharing out the files, with pugixml allocating
+         * through malloc, then through PageCache.  Documents and agents
+         * alive outside are left alone: they were allocated through malloc,
+         * which is back in place when this returns.
+         */
+        void allocators( std::ostream& os, Bench::Shape const& shape, std::vector<std::vector<char> > const& files, size_t bytes ) const
+        {
+            for ( bool pool : { false, true } )
+            {
+                if ( pool )
+                {
+                    XmlSys::PageCache::install();
+                }
+                {
+                    XmlSys::XpathAgent const            _xpath(shape.xpath_);
+                    std::vector<std::vector<char> >     _work;
+                    for ( unsigned threads : threads_ )
+                    {
+                        size_t          _count(0);
+                        Times const     _times(time( [&]() { _work = files; }, [&]() -> size_t
+                        {
+                            std::atomic<size_t>         _next(0);
+                            std::atomic<size_t>         _items(0);
+                            std::vector<std::thread>    _threads;
+                            for ( unsigned _t(0); _t < threads; ++_t )
+                            {
+                                _threads.emplace_back( [&]() -> void
+                                {
+                                    Bench::Tally                        _tally;
+                                    XmlSys::AgentMapper<Bench::Tally>   _mapper(_xpath, _tally);
+                                    std::string const                   _label;
+                                    for ( size_t _f; (_f = _next++) < _work.size(); )
+                                    {
+                                        _mapper( XmlSys::XmlDoc(_work[_f].data(), _work[_f].size()), _label );
+                                    }
+                                    _items += _tally.items_;
+                                } );
+                            }
+                            for ( auto& thread : _threads )
+                            {
+                                thread.join();
+                            }
+                            return _items;
+                        }, _count ));
+                        report( os, std::string("alloc/") + (pool ? "pool/" : "malloc/") + std::to_string( threads ), shape, files.size(), bytes, _count, _times );
+                    }
+                }
+                if ( pool )
+                {
+                    XmlSys::PageCache::uninstall();
+                }
+            }
+        }
+
+        // times formatting 'rows' with the output class made by make()
+        template<typename Make>
+        void format( std::ostream& os, std::string const& name, Bench::Shape const& shape, std::vector<Row> const& rows, Make make ) const
+        {
+            size_t          _bytes(0);
+            size_t          _count(0);
+            Times const     _times(time( [&]() -> size_t
+            {
+                Bench::NullBuffer   _buffer;
+                std::ostream        _out(&_buffer);
+                auto                _output(make( _out ));
+                render( _output, rows );
+                _out.flush();
+                _bytes = _buffer.bytes();
+                return rows.size();
+            }, _count ));
+            size_t          _items(0);
+            for ( auto const& row : rows )
+            {
+                _items += row.items_.size();
+            }
+            report( os, "output/" + name, shape, rows.size(), _bytes, _items, _times );
+        }
+
+        template<typename Output>
+        static void render( Output& output, std::vector<Row> const& rows )
+        {
+            typedef XmlSys::TargetMethods<Output>   Methods;
+            for ( auto const& row : rows )
+            {
+                Methods::label( output, row.label_ );
+                for ( size_t _i(0); _i < row.items_.size(); ++_i )
+                {
+                    if ( row.nulls_[_i] )
+                    {
+                        Methods::no_data( output );
+                    }
+                    else
+                    {
+                        Methods::item( output, row.items_[_i] );
+                    }
+                }
+                Methods::end( output );
+            }
+        }
+
+        /**
+         * One result line: 'units' is documents (rows, for output), 'bytes'
+         * the input size (output size, for output), 'count' what the
+         * benchmark found (nodes, matches, rows or items).  Rates are from
+         * the best time.
+         */
+        void report( std::ostream& os, std::string const& bench, Bench::Shape const& shape, size_t units, size_t bytes, size_t count, Times const& times ) const
+        {
+            double const    _best(times.front());
+            double const    _median(times[times.size() / 2]);
+            double const    _seconds(_best > 0 ? _best / 1000 : 1e-9);
+            os << "{\"bench\":";
+            Utility::JsonText::quoted( os, bench );
+            os << ",\"corpus\":";
+            Utility::JsonText::quoted( os, shape.name_ );
+            os << std::fixed << std::setprecision( 3 )
+               << ",\"units\":" << units
+               << ",\"bytes\":" << bytes
+               << ",\"count\":" << count
+               << ",\"best_ms\":" << _best
+               << ",\"median_ms\":" << _median
+               << ",\"mb_s\":" << bytes / _seconds / 1e6
+               << ",\"units_s\":" << std::setprecision( 0 ) << units / _seconds
+               << "}\n" << std::flush;
+        }
+
+        // "key":value out of one of our own result lines
+        static std::string const field( std::string const& line, std::string const& key )
+        {
+            std::string const   _key("\"" + key + "\":");
+            size_t              _pos(line.find( _key ));
+            if ( _pos == std::string::npos )
+            {
+                return "";
+            }
+            _pos += _key.size();
+            if ( line[_pos] == '"' )
+            {
+                return line.substr( _pos + 1, line.find( '"', _pos + 1 ) - _pos - 1 );
+            }
+            return line.substr( _pos, line.find_first_of( ",}", _pos ) - _pos );
+        }
+
+        static bool load( std::string const& file, std::map<std::string, std::string>& lines )
+        {
+            std::ifstream       _in(file.c_str());
+            if ( !_in )
+            {
+                std::cerr << "Problem with result file [" << file << "]!" << std::endl;
+                return false;
+            }
+            std::string         _line;
+            while ( std::getline( _in, _line ) )
+            {
+                if ( field( _line, "bench" ) != "meta" and !field( _line, "corpus" ).empty() )
+                {
+                    lines[field( _line, "corpus" ) + ' ' + field( _line, "bench" )] = _line;
+                }
+            }
+            return true;
+        }
+
+        // false if a benchmark got slower by more than the threshold
+        bool compare() const
+        {
+            std::map<std::string, std::string>  _old;
+            std::map<std::string, std::string>  _new;
+            if ( !load( compare_[0], _old ) or !load( compare_[1], _new ) )
+            {
+                return true;
+            }
+            bool            _ok(true);
+            std::cout << std::left << std::setw( 24 ) << "corpus bench"
+                      << std::right << std::setw( 12 ) << "old ms" << std::setw( 12 ) << "new ms" << std::setw( 10 ) << "change" << '\n';
+            for ( auto const& entry : _new )
+            {
+                auto const  _was(_old.find( entry.first ));
+                if ( _was == _old.end() )
+                {
+                    continue;
+                }
+                double const    _before(std::atof( field( _was->second, "best_ms" ).c_str() ));
+                double const    _after(std::atof( field( entry.second, "best_ms" ).c_str() ));
+                double const    _change(_before > 0 ? (_after - _before) * 100 / _before : 0);
+                bool const      _slower(_change > threshold_);
+                _ok = _ok and !_slower;
+                std::cout << std::left << std::setw( 24 ) << entry.first << std::right << std::fixed
+                          << std::setprecision( 3 ) << std::setw( 12 ) << _before << std::setw( 12 ) << _after
+                          << std::setprecision( 1 ) << std::setw( 9 ) << std::showpos << _change << std::noshowpos << '%'
+                          << (_slower ? "  slower" : "") << '\n';
+            }
+            std::cout << std::flush;
+            return _ok;
+        }
+    };
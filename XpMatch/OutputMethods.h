@@ -1,6 +1,7 @@
 
 #pragma once
 
+#include "Utility/ArrowOutput.h"
 #include "Utility/LineOutput.h"
 #include "XmlSys/TargetMethods.h"
 
@@ -18,7 +19,7 @@ namespace XmlSys
             output.source( label );
         }
 
-         static void item( Utility::PrefixedOutput& output, std::string const& item )
+         static void item( Utility::PrefixedOutput& output, Utility::StringView const& item )
         {
             output( item );
         }
@@ -40,7 +41,7 @@ namespace XmlSys
             output( label, true );
         }
         
-        static void item( Utility::DelimitedOutput& output, std::string const& item )
+        static void item( Utility::DelimitedOutput& output, Utility::StringView const& item )
         {
             output( item );
         }
@@ -64,7 +65,7 @@ namespace XmlSys
             output( label, true );
         }
         
-        static void item( Utility::QuotedOutput& output, std::string const& item )
+        static void item( Utility::QuotedOutput& output, Utility::StringView const& item )
         {
             output( item );
         }
@@ -79,6 +80,54 @@ namespace XmlSys
             output();
         }
     };
+
+    template<>
+    struct TargetMethods<Utility::JsonOutput>
+    {
+        static void label( Utility::JsonOutput& output, std::string const& label )
+        {
+            output.label( label );
+        }
+        
+        static void item( Utility::JsonOutput& output, Utility::StringView const& item )
+        {
+            output.item( item );
+        }
+        
+        static void no_data( Utility::JsonOutput& output )
+        {
+            output.no_data(); // null
+        }
+        
+        static void end( Utility::JsonOutput& output )
+        {
+            output.end();
+        }
+    };
+
+    template<>
+    struct TargetMethods<Utility::ArrowOutput>
+    {
+        static void label( Utility::ArrowOutput& output, std::string const& label )
+        {
+            output.label( label );
+        }
+        
+        static void item( Utility::ArrowOutput& output, Utility::StringView const& item )
+        {
+            output.item( item );
+        }
+        
+        static void no_data( Utility::ArrowOutput& output )
+        {
+            output.no_data(); // null
+        }
+        
+        static void end( Utility::ArrowOutput& output )
+        {
+            output.end();
+        }
+    };
     
  } // namespace Utility
 
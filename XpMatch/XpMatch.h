@@ -3,7 +3,15 @@
 
 #include "OutputMethods.h"
 #include "XmlSys/Mappers.h"
+#include "XmlSys/StreamMapper.h"
 #include "Utility/FileListProcessor.h"
+#include "Utility/FrameReader.h"
+#include "Utility/OutputSink.h"
+#include "Utility/ParallelListProcessor.h"
+#include "Utility/PipelineProcessor.h"
+#include "Utility/ResultCache.h"
+#include "Utility/Stats.h"
+#include "Utility/TreeWalker.h"
 #include "Utility/ProgramOptions.h"
 
     class XpMatch
@@ -14,9 +22,23 @@
         
         void run( int ac, char *av[] )
         {
-            if ( parse( ac, av ) )
+            if ( parse( ac, av ) and open_output() and open_cache() )
             {
+                if ( OPTION_PRESENT(vm_, "stats") )
+                {
+                    Utility::Stats::enable();
+                }
                 execute();
+                close_cache();
+                if ( Utility::Stats* _stats = Utility::Stats::active() )
+                {
+                    sink_.reset(); // the last block written, and timed
+                    _stats->report( std::cerr );
+                    if ( XmlSys::PageCache::installed() )
+                    {
+                        XmlSys::PageCache::report( std::cerr );
+                    }
+                }
             }
         }
         
@@ -33,6 +55,137 @@
         std::string                 directory_;
         std::string                 separator_;
         std::vector<std::string>    clafiles_;
+        std::string                 recurse_;
+        std::vector<std::string>    names_;
+        unsigned                    walkers_;
+        unsigned                    jobs_;
+        unsigned                    prefetch_;
+        std::string                 outfile_;
+        std::string                 flush_;
+        std::string                 cachedir_;
+        std::string                 frames_;
+        std::string                 alloc_;
+        std::unique_ptr<Utility::OutputSink>    sink_;
+        std::unique_ptr<Utility::ResultCache>      cache_;
+        
+        /**
+         * Workers for --jobs and --pipeline modes.  Each call rebinds the
+         * configured output (and a mapper over it) to the buffer of the
+         * calling thread.  With --pipeline, the document comes parsed.
+         * A TableWorker's mapper, and the evaluation state it holds, is
+         * made once per thread and pointed at each file's output.
+         */
+        template<typename Output>
+        struct TableWorker
+        {
+            typedef XmlSys::AgentSetMapper<Output>  Mapper;
+
+            TableWorker(XmlSys::AgentSet const& agents, Output const& output, XmlSys::XpathAgent const* context, bool reuse, XmlSys::ColumnProfile* profile)
+            : agents_(agents)
+            , output_(output)
+            , context_(context)
+            , reuse_(reuse)
+            , profile_(profile)
+            , id_(next_id())
+            {}
+
+            XmlSys::AgentSet const&     agents_;
+            Output const&               output_;
+            XmlSys::XpathAgent const*   context_;
+            bool                        reuse_;
+            XmlSys::ColumnProfile*      profile_;
+            uint64_t const              id_;
+            
+            template<typename Input>
+            bool operator() ( Input& input, std::string const& label, std::ostream& os ) const
+            {
+                Output          _output(output_, os);
+                Mapper&         _mapper(local( _output ));
+                return context_ 
+                    ? _mapper( input, label, *context_ )
+                    : _mapper( input, label )
+                    ;
+            }
+            
+            bool operator() ( XmlSys::XmlDoc const& doc, std::string const& label, std::ostream& os ) const
+            {
+                Output          _output(output_, os);
+                Mapper&         _mapper(local( _output ));
+                if ( context_ )
+                {
+                    _mapper( doc, label, *context_ );
+                }
+                else
+                {
+                    _mapper( doc, label );
+                }
+                return true;
+            }
+
+            // the calling thread's mapper for this worker, made on its first
+            // call, writing to 'output'
+            Mapper& local( Output& output ) const
+            {
+                thread_local std::unique_ptr<Mapper>    _mapper;
+                thread_local uint64_t                   _id(0);
+                if ( !_mapper or _id != id_ )
+                {
+                    _mapper.reset( new Mapper(agents_, output) );
+                    _mapper->reuse( reuse_ ).profile( profile_ );
+                    _id = id_;
+                }
+                return _mapper->target( output );
+            }
+
+            // tells workers apart from one made later at the same address
+            static uint64_t next_id()
+            {
+                static std::atomic<uint64_t>    _next(0);
+                return ++_next;
+            }
+        };
+        
+        template<typename Output>
+        struct StreamWorker
+        {
+            XmlSys::StreamPlan const&   plan_;
+            Output const&               output_;
+            
+            template<typename Input>
+            bool operator() ( Input& input, std::string const& label, std::ostream& os ) const
+            {
+                Output                              _output(output_, os);
+                XmlSys::StreamSetMapper<Output>     _mapper(plan_, _output);
+                return _mapper( input, label );
+            }
+        };
+        
+        template<typename Output>
+        struct GrepWorker
+        {
+            XmlSys::XpathAgent const&       agent_;
+            Output const&                   output_;
+            bool                            reuse_;
+            bool                            first_;
+            
+            template<typename Input>
+            bool operator() ( Input& input, std::string const& label, std::ostream& os ) const
+            {
+                Output                          _output(output_, os);
+                XmlSys::AgentMapper<Output>     _mapper(agent_, _output);
+                _mapper.reuse( reuse_ ).first( first_ );
+                return _mapper( input, label );
+            }
+            
+            bool operator() ( XmlSys::XmlDoc const& doc, std::string const& label, std::ostream& os ) const
+            {
+                Output                          _output(output_, os);
+                XmlSys::AgentMapper<Output>     _mapper(agent_, _output);
+                _mapper.first( first_ );
+                _mapper( doc, label );
+                return true;
+            }
+        };
         
         bool parse( int ac, char *av[] )
         {       
@@ -45,6 +198,7 @@
                 ( "table,t", po::value<std::string>(&table_), "column-specs filename" )
                 ( "column,c", po::value<std::vector<std::string> >(&columns_), "inline column-spec (repeatable)" )
                 ( "initial,i", po::value<std::string>(&initial_), "initial context xpath" )
+                ( "stream", "DOM-free single pass (simple paths only)" )
                 ;
             po::options_description         _grep("Grep mode options");
             _grep.add_options()
@@ -56,13 +210,37 @@
             _input.add_options()
                 ( "listfile,l", po::value<std::string>(&listfile_), "list of files filename" )
                 ( "directory,d", po::value<std::string>(&directory_), "directory for files (default .)" )
+                ( "recurse,R", po::value<std::string>(&recurse_), "walk directory tree for files (instead of -d and a list)" )
+                ( "name", po::value<std::vector<std::string> >(&names_), "file name glob with -R, e.g. '*.xml' (repeatable)" )
+                ( "walkers", po::value<unsigned>(&walkers_)->default_value( 1 ), "threads listing directories with -R" )
                 ( "readxml,r", "read xml content from STDIN")
+                ( "frames", po::value<std::string>(&frames_), "many documents on STDIN, each ended by a NUL byte (nul) or after a 'bytes [id]' header line (len)" )
+                ( "mmap,m", "memory-map input and parse in place" )
+                ( "uring", "read files in batches of --prefetch through io_uring, and parse in place" )
+                ;
+            po::options_description         _process("Processing options");
+            _process.add_options()
+                ( "jobs,j", po::value<unsigned>(&jobs_)->default_value( 1 ), "worker threads (output stays in input order)" )
+                ( "reuse,u", "reuse one document and its memory pages per worker" )
+                ( "alloc", po::value<std::string>(&alloc_), "parser memory: pool (per-thread free lists) or malloc (default: pool with -u, else malloc)" )
+                ( "lazy", "decode references and line ends in extracted values only" )
+                ( "early", "stop reading a document once its row is known (table mode, one row per document), or at the first match (grep mode)" )
+                ( "pipeline", "staged threads: read ahead, parse (-j), evaluate (-j), write" )
+                ( "prefetch", po::value<unsigned>(&prefetch_)->default_value( 8 ), "files read ahead (with --pipeline), or per batch (with --uring)" )
+                ( "queues", "report --pipeline queue counters on STDERR" )
+                ( "stats", "report counts, rates and time per stage on STDERR" )
+                ( "profile", "time each table column on its own, and rank the columns by cost on STDERR" )
+                ( "cache", po::value<std::string>(&cachedir_), "replay output of unchanged files from a result cache in this directory" )
                 ;
-            po::options_description         _output("Format (output) options [Note: -q and -s are mutually exclusive]");
+            po::options_description         _output("Format (output) options [Note: -q, -s, --arrow and --json are mutually exclusive]");
             _output.add_options()
                 ( "noheader,n", "suppress header row (or no titles in grep mode)" )
                 ( "quoted,q", "CSV-style output for Excel (in table mode)" )
+                ( "arrow", "Arrow IPC stream output (in table mode)" )
+                ( "json", "JSON Lines output: an object per row (or per match in grep mode)" )
                 ( "separator,s", po::value<std::string>(&separator_), "delimiter in table mode output (default TAB)" )
+                ( "output,O", po::value<std::string>(&outfile_), "write to file instead of STDOUT" )
+                ( "flush", po::value<std::string>(&flush_), "when to write: end, N (bytes) or Nms (default: end, or every row to a terminal)" )
                 ;
             po::options_description         _hidden("Command line file list");
             _hidden.add_options()
@@ -74,11 +252,11 @@
             po::options_description         _visible("Options");
             _visible.add( _help )
                 .add( _table ).add( _grep )
-                .add( _input ).add( _output );
+                .add( _input ).add( _process ).add( _output );
             po::options_description         _all("All options");
             _all.add( _help )
                 .add( _table ).add( _grep )
-                .add( _input ).add( _output )
+                .add( _input ).add( _process ).add( _output )
                 .add( _hidden );
             
             po::store( po::command_line_parser( ac, av )
@@ -96,9 +274,111 @@
             return true;
         }
         
+        // output buffering and destination
+        bool open_output()
+        {
+            sink_.reset( new Utility::OutputSink(outfile_) );
+            if ( !*sink_ )
+            {
+                std::cerr << "Problem with output file [" << outfile_ << "]!" << std::endl;
+                return false;
+            }
+            if ( OPTION_ABSENT(vm_, "flush") )
+            {
+                if ( sink_->interactive() )
+                {
+                    sink_->policy( Utility::OutputSink::Bytes, 1 );
+                }
+                return true;
+            }
+            char*           _end(nullptr);
+            unsigned long   _amount(std::strtoul( flush_.c_str(), &_end, 10 ));
+            if ( flush_ == "end" )
+            {
+                sink_->policy( Utility::OutputSink::AtEnd );
+            }
+            else
+            if ( _end != flush_.c_str() and *_end == 0 )
+            {
+                sink_->policy( Utility::OutputSink::Bytes, _amount );
+            }
+            else
+            if ( _end != flush_.c_str() and std::string(_end) == "ms" )
+            {
+                sink_->policy( Utility::OutputSink::Interval, _amount );
+            }
+            else
+            {
+                std::cerr << "Problem with flush policy [" << flush_ << "]!" << std::endl;
+                return false;
+            }
+            return true;
+        }
+        
+        // output of earlier runs with the same expressions and format
+        bool open_cache()
+        {
+            if ( OPTION_ABSENT(vm_, "cache") )
+            {
+                return true;
+            }
+            if ( OPTION_PRESENT(vm_, "arrow") )
+            {
+                std::cerr << "The --cache option does not apply to --arrow output." << std::endl;
+                return false;
+            }
+            std::ostringstream  _signature;
+            _signature << "xpath\n" << xpath_ << "\ninitial\n" << initial_ << "\ncolumns\n";
+            for ( auto const& column : columns_ )
+            {
+                _signature << column << '\n';
+            }
+            if ( OPTION_PRESENT(vm_, "table") )
+            {
+                std::ifstream       _specs(table_.c_str());
+                _signature << "table\n" << _specs.rdbuf();
+            }
+            _signature << "\noptions\n";
+            for ( char const* option : { "stream", "blanks", "only", "noheader", "quoted", "json", "separator", "early", "lazy" } )
+            {
+                _signature << (OPTION_PRESENT(vm_, option) ? '1' : '0');
+            }
+            _signature << '\n' << separator_;
+            cache_.reset( new Utility::ResultCache(cachedir_, _signature.str()) );
+            return true;
+        }
+        
+        void close_cache() const
+        {
+            if ( cache_ )
+            {
+                if ( !cache_->save() )
+                {
+                    std::cerr << "Problem writing cache file [" << cache_->file() << "]!" << std::endl;
+                }
+                std::cerr << "cache: " << cache_->hits() << " hits, " << cache_->misses() << " misses" << std::endl;
+            }
+        }
+        
         // handle mode
         void execute() const
         {
+            std::string const   _alloc(OPTION_PRESENT(vm_, "alloc") ? alloc_ : OPTION_PRESENT(vm_, "reuse") ? "pool" : "malloc");
+            if ( _alloc == "pool" )
+            {
+                // staged, documents are freed by other threads than the
+                // ones that parse: pools there would fill and never serve
+                if ( !staged() )
+                {
+                    XmlSys::PageCache::install();
+                }
+            }
+            else
+            if ( _alloc != "malloc" )
+            {
+                std::cerr << "Problem with allocator [" << alloc_ << "]!" << std::endl;
+                return;
+            }
             if ( OPTION_PRESENT(vm_, "column") )
             {
                 do_output( XmlSys::AgentSet(columns_.begin(), columns_.end()) );
@@ -130,41 +410,153 @@
         // set output style for table mode
         void do_output( XmlSys::AgentSet const& agents ) const
         {
+            if ( OPTION_PRESENT(vm_, "arrow") )
+            {
+                Utility::ArrowOutput        _output(*sink_);
+                agents.headers( _output ); // column names, in place of a header row
+                do_table( agents, _output, false );
+            }
+            else
+            if ( OPTION_PRESENT(vm_, "json") )
+            {
+                Utility::JsonOutput         _output(*sink_);
+                agents.headers( _output ); // keys, in place of a header row
+                do_table( agents, _output, false );
+            }
+            else
             if ( OPTION_PRESENT(vm_, "quoted") )
             {
-                Utility::QuotedOutput       _output;
-                do_table( agents, _output );
+                Utility::QuotedOutput       _output(*sink_);
+                do_table( agents, _output, OPTION_ABSENT(vm_, "noheader") );
             }
             else
             {
-                Utility::DelimitedOutput    _output;
+                Utility::DelimitedOutput    _output(*sink_);
                 if ( OPTION_PRESENT(vm_, "separator") )
                 {
                     _output.separator( separator_ );
                 }
-                do_table( agents, _output );
+                do_table( agents, _output, OPTION_ABSENT(vm_, "noheader") );
             }
         }
         
         template<typename Output>
-        void do_table( XmlSys::AgentSet const& agents, Output& output ) const
+        void do_table( XmlSys::AgentSet const& agents, Output& output, bool header ) const
         {
             // associate agent set with output method
             XmlSys::AgentSetMapper<Output>  _mapper(agents, output);
+            _mapper.reuse( OPTION_PRESENT(vm_, "reuse") );
             
-            if ( OPTION_ABSENT(vm_, "noheader") )
+            if ( OPTION_PRESENT(vm_, "stream") or early( agents ) )
+            {
+                XmlSys::StreamPlan  _plan(agents, initial_); // reject unsupported paths before any output
+                _plan.early( OPTION_PRESENT(vm_, "early") );
+                if ( header )
+                {
+                    _mapper.header();
+                }
+                do_streaming( _plan, output );
+                return;
+            }
+            if ( header )
             {
                 _mapper.header();
             }
+            XmlSys::XpathAgent::deferred() = OPTION_PRESENT(vm_, "lazy") and agents.deferrable()
+                and (initial_.empty() or XmlSys::XpathAgent(initial_).deferrable());
+            std::unique_ptr<XmlSys::ColumnProfile>  _profile(OPTION_PRESENT(vm_, "profile") ? new XmlSys::ColumnProfile(agents) : nullptr);
+            _mapper.profile( _profile.get() );
             // run
             if ( initial_.length() > 0 )  // this could be more robust
             {
-                using namespace std::placeholders;
-                auto    _lambda(std::bind( _mapper, _1, _2, initial_ ));
-                dispatch( _lambda );
+                XmlSys::XpathAgent  _context(initial_);
+                if ( staged() )
+                {
+                    TableWorker<Output>     _worker{ agents, output, &_context, false, _profile.get() };
+                    dispatch_staged( _worker );
+                }
+                else
+                if ( workers() )
+                {
+                    TableWorker<Output>     _worker{ agents, output, &_context, OPTION_PRESENT(vm_, "reuse"), _profile.get() };
+                    dispatch_parallel( _worker );
+                }
+                else
+                {
+                    using namespace std::placeholders;
+                    auto    _lambda(std::bind( _mapper, _1, _2, _context ));
+                    dispatch( _lambda );
+                }
             }
             else
+            if ( staged() )
             {
+                TableWorker<Output>     _worker{ agents, output, nullptr, false, _profile.get() };
+                dispatch_staged( _worker );
+            }
+            else
+            if ( workers() )
+            {
+                TableWorker<Output>     _worker{ agents, output, nullptr, OPTION_PRESENT(vm_, "reuse"), _profile.get() };
+                dispatch_parallel( _worker );
+            }
+            else
+            {
+                dispatch( _mapper );
+            }
+            if ( _profile )
+            {
+                _profile->report( std::cerr );
+            }
+        }
+        
+        // --early: by the streaming scan, if it can evaluate the expressions
+        // and a document has one row at most (else --early has no effect)
+        bool early( XmlSys::AgentSet const& agents ) const
+        {
+            if ( OPTION_ABSENT(vm_, "early") or OPTION_PRESENT(vm_, "profile") )
+            {
+                return false;
+            }
+            try
+            {
+                return XmlSys::StreamPlan(agents, initial_).single();
+            }
+            catch ( XmlSys::XpathAgent::BadXpath const& )
+            {
+                return false;
+            }
+        }
+        
+        // --early in grep mode: by the streaming scan, if it can evaluate
+        // the expression (else the first match is taken from the document)
+        bool early( XmlSys::XpathAgent const& agent ) const
+        {
+            if ( OPTION_ABSENT(vm_, "early") )
+            {
+                return false;
+            }
+            try
+            {
+                return XmlSys::StreamPlan(agent).single();
+            }
+            catch ( XmlSys::XpathAgent::BadXpath const& )
+            {
+                return false;
+            }
+        }
+        
+        template<typename Output>
+        void do_streaming( XmlSys::StreamPlan const& plan, Output& output ) const
+        {
+            if ( workers() )
+            {
+                StreamWorker<Output>    _worker{ plan, output };
+                dispatch_parallel( _worker );
+            }
+            else
+            {
+                XmlSys::StreamSetMapper<Output>     _mapper(plan, output);
                 dispatch( _mapper );
             }
         }
@@ -173,44 +565,232 @@
         template<typename Client>
         void dispatch( Client& client ) const
         {
+            if ( OPTION_PRESENT(vm_, "frames") )
+            {
+                do_frames( [&]( Utility::MappedFile& input, std::string const& label ) { client( input, label ); } );
+                return;
+            }
             if ( OPTION_PRESENT(vm_, "readxml") )
             {
-                client( std::cin, "STDIN" );
+                if ( OPTION_PRESENT(vm_, "mmap") )
+                {
+                    Utility::MappedFile     _input(STDIN_FILENO);
+                    client( _input, "STDIN" );
+                }
+                else
+                if ( Utility::Compressed::maybe( std::cin.peek() ) )
+                {
+                    Utility::MappedFile     _input(std::cin);
+                    if ( _input )
+                    {
+                        client( _input, "STDIN" );
+                    }
+                    else
+                    {
+                        std::cerr << "Could not read compressed STDIN!" << std::endl;
+                    }
+                }
+                else
+                {
+                    client( std::cin, "STDIN" );
+                }
                 return;
             }
             
-            Utility::FileListProcessor<Client>      _reader(client, directory_);
+            Utility::FileListProcessor<Client>      _reader(client, directory());
+            _reader
+                .mapped( OPTION_PRESENT(vm_, "mmap") )
+                .batched( OPTION_PRESENT(vm_, "uring") ? prefetch_ : 0 )
+                ;
+            feed( _reader );
+        }
+        
+        template<typename Client>
+        void dispatch_parallel( Client& client ) const
+        {
+            if ( OPTION_PRESENT(vm_, "frames") )
+            {
+                do_frames( [&]( Utility::MappedFile& input, std::string const& label ) { client( input, label, *sink_ ); } );
+                return;
+            }
+            if ( OPTION_PRESENT(vm_, "readxml") )
+            {
+                if ( OPTION_PRESENT(vm_, "mmap") )
+                {
+                    Utility::MappedFile     _input(STDIN_FILENO);
+                    client( _input, "STDIN", *sink_ );
+                }
+                else
+                if ( Utility::Compressed::maybe( std::cin.peek() ) )
+                {
+                    Utility::MappedFile     _input(std::cin);
+                    if ( _input )
+                    {
+                        client( _input, "STDIN", *sink_ );
+                    }
+                    else
+                    {
+                        std::cerr << "Could not read compressed STDIN!" << std::endl;
+                    }
+                }
+                else
+                {
+                    client( std::cin, "STDIN", *sink_ );
+                }
+                return;
+            }
             
+            Utility::ParallelListProcessor<Client>  _reader(client, directory(), jobs_, *sink_);
+            _reader
+                .mapped( OPTION_PRESENT(vm_, "mmap") )
+                .cache( cache_.get() )
+                ;
+            feed( _reader );
+        }
+        
+        // documents framed on STDIN, each parsed in place in the read buffer
+        template<typename Handle>
+        void do_frames( Handle handle ) const
+        {
+            if ( frames_ != "nul" and frames_ != "len" )
+            {
+                std::cerr << "Problem with frame format [" << frames_ << "]!" << std::endl;
+                return;
+            }
+            Utility::FrameReader    _reader(STDIN_FILENO, frames_ == "nul" ? Utility::FrameReader::Nul : Utility::FrameReader::Length);
+            char*                   _data(nullptr);
+            size_t                  _size(0);
+            std::string             _label;
+            while ( _reader.next( _data, _size, _label ) )
+            {
+                Utility::MappedFile     _input(_data, _size);
+                handle( _input, _label );
+            }
+            if ( !_reader.error().empty() )
+            {
+                std::cerr << "Problem with framed input: " << _reader.error() << std::endl;
+            }
+        }
+        
+        // the worker path buffers each file's output, as --cache needs
+        bool workers() const
+        {
+            return jobs_ > 1 or cache_;
+        }
+        
+        // --pipeline applies to lists of files (and not to --stream or --cache)
+        bool staged() const
+        {
+            return OPTION_PRESENT(vm_, "pipeline") and OPTION_ABSENT(vm_, "readxml")
+                and OPTION_ABSENT(vm_, "frames") and !cache_;
+        }
+        
+        template<typename Client>
+        void dispatch_staged( Client& client ) const
+        {
+            Utility::PipelineProcessor<Client, XmlSys::XmlDoc>  _reader(client, directory(), jobs_, *sink_);
+            _reader
+                .prefetch( prefetch_ )
+                .report( OPTION_PRESENT(vm_, "queues") )
+                .uring( OPTION_PRESENT(vm_, "uring") )
+                ;
+            feed( _reader );
+        }
+        
+        // file names are relative to this
+        std::string const& directory() const
+        {
+            return OPTION_PRESENT(vm_, "recurse") ? recurse_ : directory_;
+        }
+        
+        template<typename Reader>
+        void feed( Reader& reader ) const
+        {
+            if ( OPTION_PRESENT(vm_, "recurse") )
+            {
+                Utility::TreeWalker<>   _walker(recurse_);
+                _walker
+                    .patterns( names_ )
+                    .threads( walkers_ )
+                    ;
+                reader.do_walk( _walker );
+            }
+            else
             if ( OPTION_PRESENT(vm_, "listfile") )
             {
-                _reader.do_file( listfile_ );
+                reader.do_file( listfile_ );
             }
             else
             if ( OPTION_PRESENT(vm_, "clafiles") )
             {
-                _reader.do_list( clafiles_.begin(), clafiles_.end() );
+                reader.do_list( clafiles_.begin(), clafiles_.end() );
             }
             else
             {
                 //std::cerr << "[Reading <STDIN> for list of files...]" << std::endl;
-                _reader.do_stream( std::cin );
+                reader.do_stream( std::cin );
             }
         }
         
         void do_grep() const
         {
+            if ( OPTION_PRESENT(vm_, "stream") )
+            {
+                std::cerr << "The --stream option applies to table mode only." << std::endl;
+                return;
+            }
             // configure output options
-            Utility::PrefixedOutput     _output;
+            if ( OPTION_PRESENT(vm_, "json") )
+            {
+                Utility::JsonOutput         _output(*sink_);
+                _output
+                    .hits( true )
+                    .keys( "Source", xpath_ )
+                    .blanks( OPTION_PRESENT(vm_, "blanks") )
+                    .only( OPTION_PRESENT(vm_, "only") )
+                    .notitle( OPTION_PRESENT(vm_, "noheader") )
+                    ;
+                do_grep( _output );
+                return;
+            }
+            Utility::PrefixedOutput     _output(*sink_);
             _output
                 .blanks( OPTION_PRESENT(vm_, "blanks") )
                 .only( OPTION_PRESENT(vm_, "only") )
                 .notitle( OPTION_PRESENT(vm_, "noheader") )
                 ;
+            do_grep( _output );
+        }
+        
+        template<typename Output>
+        void do_grep( Output& output ) const
+        {
             // configure agent
             XmlSys::XpathAgent          _agent(xpath_);
+            XmlSys::XpathAgent::deferred() = OPTION_PRESENT(vm_, "lazy") and _agent.deferrable();
+            if ( early( _agent ) )
+            {
+                XmlSys::StreamPlan      _plan(_agent);
+                _plan.early( true );
+                do_streaming( _plan, output );
+                return;
+            }
+            bool const                  _first(OPTION_PRESENT(vm_, "early"));
+            if ( staged() )
+            {
+                GrepWorker<Output>      _worker{ _agent, output, false, _first };
+                dispatch_staged( _worker );
+                return;
+            }
+            if ( workers() )
+            {
+                GrepWorker<Output>      _worker{ _agent, output, OPTION_PRESENT(vm_, "reuse"), _first };
+                dispatch_parallel( _worker );
+                return;
+            }
             // associate agent with output method
-            XmlSys::AgentMapper<Utility::PrefixedOutput>
-                                        _mapper(_agent, _output);
+            XmlSys::AgentMapper<Output> _mapper(_agent, output);
+            _mapper.reuse( OPTION_PRESENT(vm_, "reuse") ).first( _first );
             // run for input options
             dispatch( _mapper );
         }